@@ -34,4 +34,9 @@ struct attributes {
   int double_buffer;
   int depth_size;
   int gles_version;
+  int refresh_rate;
+  int device_count;
+  int device_index;
+  int device_software;
+  char device_name[64];
 };
@@ -0,0 +1,108 @@
+/*
+  TinyGLUT                 Small implementation of GLUT (OpenGL Utility Toolkit)
+  Copyright (c) 2015-2024, Nicolas Caramelli
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "blit.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define FRAMES 50
+
+static const char *isa_name[BLIT_ISAS] = { "scalar", "sse2", "avx2", "neon" };
+static const char *format_name[BLIT_FORMATS] = { "rgb565", "rgb888", "bgr888", "xrgb8888" };
+static const int bpp[BLIT_FORMATS] = { 2, 3, 3, 4 };
+
+static double now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* frames per second and destination bandwidth of each kernel on a 1920x1080 frame */
+static void report(const char *name, int isa, double start, int size)
+{
+  double time = (now() - start) / FRAMES;
+
+  printf("%-8s %-16s %8.1f fps %8.1f MB/s\n", isa_name[isa], name, 1 / time, size / time / 1e6);
+}
+
+int main()
+{
+  unsigned char *src = NULL, *dst = NULL;
+  double start = 0;
+  int isa = 0, format = 0, i = 0, j = 0;
+  char name[32];
+
+  src = malloc(WIDTH * HEIGHT * 4);
+  dst = malloc(WIDTH * HEIGHT * 4);
+  if (!src || !dst) {
+    printf("malloc failed\n");
+    return EXIT_FAILURE;
+  }
+
+  for (i = 0; i < WIDTH * HEIGHT * 4; i++) {
+    src[i] = rand();
+  }
+
+  for (isa = 0; isa < BLIT_ISAS; isa++) {
+    if (blit_set_isa(isa)) {
+      continue;
+    }
+
+    for (format = 0; format < BLIT_FORMATS; format++) {
+      start = now();
+      for (i = 0; i < FRAMES; i++) {
+        for (j = 0; j < HEIGHT; j++) {
+          blit_convert(format, dst + j * WIDTH * bpp[format], src + j * WIDTH * 4, WIDTH);
+        }
+      }
+      snprintf(name, sizeof(name), "convert %s", format_name[format]);
+      report(name, isa, start, WIDTH * HEIGHT * bpp[format]);
+    }
+
+    start = now();
+    for (i = 0; i < FRAMES; i++) {
+      blit_copy(dst, WIDTH * 4, src, WIDTH * 4, WIDTH * 4, HEIGHT);
+    }
+    report("copy", isa, start, WIDTH * HEIGHT * 4);
+
+    start = now();
+    for (i = 0; i < FRAMES; i++) {
+      blit_fill(dst, WIDTH * 2, i, 2, WIDTH, HEIGHT);
+    }
+    report("fill 16 bpp", isa, start, WIDTH * HEIGHT * 2);
+  }
+
+  free(src);
+  free(dst);
+
+  return EXIT_SUCCESS;
+}
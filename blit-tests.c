@@ -0,0 +1,183 @@
+/*
+  TinyGLUT                 Small implementation of GLUT (OpenGL Utility Toolkit)
+  Copyright (c) 2015-2024, Nicolas Caramelli
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <check.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blit.h"
+
+#define GUARD 32
+
+static const int bpp[BLIT_FORMATS] = { 2, 3, 3, 4 };
+
+static void random_fill(uint8_t *buffer, int size)
+{
+  int i = 0;
+
+  for (i = 0; i < size; i++) {
+    buffer[i] = rand();
+  }
+}
+
+/* blit_set_isa test */
+
+START_TEST(test_blit_set_isa)
+{
+  ck_assert_int_eq(blit_set_isa(-1), -1);
+  ck_assert_int_eq(blit_set_isa(BLIT_ISAS), -1);
+  ck_assert_int_eq(blit_set_isa(BLIT_SCALAR), 0);
+  ck_assert_int_eq(blit_isa(), BLIT_SCALAR);
+}
+END_TEST
+
+/* blit_convert test */
+
+START_TEST(test_blit_convert)
+{
+  const uint8_t golden_src[8] = { 0xFF, 0x80, 0x08, 0x00, 0x12, 0x34, 0x56, 0x78 };
+  const uint8_t golden_rgb888[6] = { 0xFF, 0x80, 0x08, 0x12, 0x34, 0x56 };
+  const uint8_t golden_bgr888[6] = { 0x08, 0x80, 0xFF, 0x56, 0x34, 0x12 };
+  const uint8_t golden_xrgb8888[8] = { 0x08, 0x80, 0xFF, 0xFF, 0x56, 0x34, 0x12, 0xFF };
+  uint16_t rgb565[2];
+  uint8_t src[4 * 131 + 3], reference[4 * 131 + GUARD], dst[4 * 131 + 2 + GUARD];
+  int isa = 0, format = 0, count = 0, offset = 0;
+
+  ck_assert_int_eq(blit_set_isa(BLIT_SCALAR), 0);
+
+  blit_convert(BLIT_RGB565, rgb565, golden_src, 2);
+  ck_assert_uint_eq(rgb565[0], 0xFC01);
+  ck_assert_uint_eq(rgb565[1], 0x11AA);
+  blit_convert(BLIT_RGB888, dst, golden_src, 2);
+  ck_assert_mem_eq(dst, golden_rgb888, 6);
+  blit_convert(BLIT_BGR888, dst, golden_src, 2);
+  ck_assert_mem_eq(dst, golden_bgr888, 6);
+  blit_convert(BLIT_XRGB8888, dst, golden_src, 2);
+  ck_assert_mem_eq(dst, golden_xrgb8888, 8);
+
+  /* every count up to several vectors, on unaligned buffers */
+  random_fill(src, sizeof(src));
+  for (isa = 0; isa < BLIT_ISAS; isa++) {
+    if (blit_set_isa(isa)) {
+      continue;
+    }
+    for (format = 0; format < BLIT_FORMATS; format++) {
+      for (count = 0; count <= 131; count++) {
+        offset = count & 3;
+        memset(reference, 0xA5, sizeof(reference));
+        memset(dst, 0xA5, sizeof(dst));
+        blit_set_isa(BLIT_SCALAR);
+        blit_convert(format, reference, src + offset, count);
+        blit_set_isa(isa);
+        blit_convert(format, dst + (offset & 2), src + offset, count);
+        ck_assert_mem_eq(dst + (offset & 2), reference, count * bpp[format] + GUARD);
+      }
+    }
+  }
+}
+END_TEST
+
+/* blit_copy test */
+
+START_TEST(test_blit_copy)
+{
+  uint8_t src[64 * 300], reference[64 * 300], dst[64 * 300];
+  int isa = 0, width = 0, height = 0;
+
+  random_fill(src, sizeof(src));
+  for (isa = 0; isa < BLIT_ISAS; isa++) {
+    if (blit_set_isa(isa)) {
+      continue;
+    }
+    for (width = 0; width <= 257; width += 1 + width / 8) {
+      for (height = 1; height <= 64; height *= 4) {
+        memset(reference, 0xA5, sizeof(reference));
+        memset(dst, 0xA5, sizeof(dst));
+        blit_set_isa(BLIT_SCALAR);
+        blit_copy(reference + 1, 299, src + 3, 281, width, height);
+        blit_set_isa(isa);
+        blit_copy(dst + 1, 299, src + 3, 281, width, height);
+        ck_assert_mem_eq(dst, reference, sizeof(reference));
+      }
+    }
+  }
+}
+END_TEST
+
+/* blit_fill test */
+
+START_TEST(test_blit_fill)
+{
+  uint8_t reference[32 * 520], dst[32 * 520];
+  uint16_t value16 = 0;
+  int isa = 0, depth = 0, width = 0;
+
+  ck_assert_int_eq(blit_set_isa(BLIT_SCALAR), 0);
+  blit_fill(dst, 0, 0x123456, 3, 2, 1);
+  ck_assert_mem_eq(dst, "\x56\x34\x12\x56\x34\x12", 6);
+  blit_fill(dst, 0, 0xF800, 2, 1, 1);
+  memcpy(&value16, dst, 2);
+  ck_assert_uint_eq(value16, 0xF800);
+
+  for (isa = 0; isa < BLIT_ISAS; isa++) {
+    if (blit_set_isa(isa)) {
+      continue;
+    }
+    for (depth = 1; depth <= 4; depth++) {
+      for (width = 0; width <= 129; width++) {
+        memset(reference, 0xA5, sizeof(reference));
+        memset(dst, 0xA5, sizeof(dst));
+        blit_set_isa(BLIT_SCALAR);
+        blit_fill(reference + depth, 520, 0x89ABCDEF, depth, width, 3);
+        blit_set_isa(isa);
+        blit_fill(dst + depth, 520, 0x89ABCDEF, depth, width, 3);
+        ck_assert_mem_eq(dst, reference, sizeof(reference));
+      }
+    }
+  }
+}
+END_TEST
+
+int main()
+{
+  Suite *s;
+  TCase *tc;
+  SRunner *sr;
+  int n;
+
+  s = suite_create("blit");
+  tc = tcase_create("Tests");
+  tcase_add_test(tc, test_blit_set_isa);
+  tcase_add_test(tc, test_blit_convert);
+  tcase_add_test(tc, test_blit_copy);
+  tcase_add_test(tc, test_blit_fill);
+  suite_add_tcase(s, tc);
+  sr = srunner_create(s);
+  srunner_run_all(sr, CK_NORMAL);
+  n = srunner_ntests_failed(sr);
+
+  return n == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,493 @@
+/*
+  TinyGLUT                 Small implementation of GLUT (OpenGL Utility Toolkit)
+  Copyright (c) 2015-2024, Nicolas Caramelli
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLIT_X86
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "blit.h"
+
+struct blit_kernels {
+  void (*convert[BLIT_FORMATS])(uint8_t *dst, const uint8_t *src, int count);
+  void (*copy_row)(uint8_t *dst, const uint8_t *src, int size);
+  void (*fill_row)(uint8_t *dst, unsigned int pixel, int bpp, int width);
+};
+
+/* scalar kernels, the reference of the others and used for their remaining pixels */
+
+static void convert_rgb565_scalar(uint8_t *dst, const uint8_t *src, int count)
+{
+  uint16_t value = 0;
+  int i = 0;
+
+  for (i = 0; i < count; i++, src += 4, dst += 2) {
+    value = (src[0] & 0xF8) << 8 | (src[1] & 0xFC) << 3 | src[2] >> 3;
+    memcpy(dst, &value, 2);
+  }
+}
+
+static void convert_rgb888_scalar(uint8_t *dst, const uint8_t *src, int count)
+{
+  int i = 0;
+
+  for (i = 0; i < count; i++, src += 4, dst += 3) {
+    dst[0] = src[0];
+    dst[1] = src[1];
+    dst[2] = src[2];
+  }
+}
+
+static void convert_bgr888_scalar(uint8_t *dst, const uint8_t *src, int count)
+{
+  int i = 0;
+
+  for (i = 0; i < count; i++, src += 4, dst += 3) {
+    dst[0] = src[2];
+    dst[1] = src[1];
+    dst[2] = src[0];
+  }
+}
+
+static void convert_xrgb8888_scalar(uint8_t *dst, const uint8_t *src, int count)
+{
+  int i = 0;
+
+  for (i = 0; i < count; i++, src += 4, dst += 4) {
+    dst[0] = src[2];
+    dst[1] = src[1];
+    dst[2] = src[0];
+    dst[3] = 0xFF;
+  }
+}
+
+static void copy_row_scalar(uint8_t *dst, const uint8_t *src, int size)
+{
+  memcpy(dst, src, size);
+}
+
+static void fill_row_scalar(uint8_t *dst, unsigned int pixel, int bpp, int width)
+{
+  uint16_t value16 = pixel;
+  uint32_t value32 = pixel;
+  int i = 0;
+
+  switch (bpp) {
+    case 1:
+      memset(dst, pixel, width);
+      break;
+    case 2:
+      for (i = 0; i < width; i++, dst += 2) {
+        memcpy(dst, &value16, 2);
+      }
+      break;
+    case 3:
+      for (i = 0; i < width; i++, dst += 3) {
+        dst[0] = pixel;
+        dst[1] = pixel >> 8;
+        dst[2] = pixel >> 16;
+      }
+      break;
+    case 4:
+      for (i = 0; i < width; i++, dst += 4) {
+        memcpy(dst, &value32, 4);
+      }
+      break;
+  }
+}
+
+#ifdef BLIT_X86
+
+/* SSE2 has no byte shuffle, the 24 bits formats are left to the scalar kernels */
+
+__attribute__((target("sse2")))
+static void convert_rgb565_sse2(uint8_t *dst, const uint8_t *src, int count)
+{
+  const __m128i r = _mm_set1_epi32(0xF8), g = _mm_set1_epi32(0xFC00), b = _mm_set1_epi32(0xF80000);
+  const __m128i bias32 = _mm_set1_epi32(0x8000), bias16 = _mm_set1_epi16((short)0x8000);
+  __m128i p0, p1;
+  int i = 0;
+
+  for (i = 0; i + 8 <= count; i += 8, src += 32, dst += 16) {
+    p0 = _mm_loadu_si128((const __m128i *)src);
+    p1 = _mm_loadu_si128((const __m128i *)(src + 16));
+    p0 = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(p0, r), 8), _mm_srli_epi32(_mm_and_si128(p0, g), 5)), _mm_srli_epi32(_mm_and_si128(p0, b), 19));
+    p1 = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(p1, r), 8), _mm_srli_epi32(_mm_and_si128(p1, g), 5)), _mm_srli_epi32(_mm_and_si128(p1, b), 19));
+    /* the signed saturating pack is made exact by biasing the 16 bits values */
+    p0 = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(p0, bias32), _mm_sub_epi32(p1, bias32)), bias16);
+    _mm_storeu_si128((__m128i *)dst, p0);
+  }
+
+  convert_rgb565_scalar(dst, src, count - i);
+}
+
+__attribute__((target("sse2")))
+static void convert_xrgb8888_sse2(uint8_t *dst, const uint8_t *src, int count)
+{
+  const __m128i low = _mm_set1_epi32(0xFF), g = _mm_set1_epi32(0xFF00), x = _mm_set1_epi32(0xFF000000);
+  __m128i p;
+  int i = 0;
+
+  for (i = 0; i + 4 <= count; i += 4, src += 16, dst += 16) {
+    p = _mm_loadu_si128((const __m128i *)src);
+    p = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(p, low), 16), _mm_and_si128(p, g)), _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), low), x));
+    _mm_storeu_si128((__m128i *)dst, p);
+  }
+
+  convert_xrgb8888_scalar(dst, src, count - i);
+}
+
+__attribute__((target("sse2")))
+static void copy_row_sse2(uint8_t *dst, const uint8_t *src, int size)
+{
+  for (; size >= 64; size -= 64, src += 64, dst += 64) {
+    _mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_loadu_si128((const __m128i *)(src + 16)));
+    _mm_storeu_si128((__m128i *)(dst + 32), _mm_loadu_si128((const __m128i *)(src + 32)));
+    _mm_storeu_si128((__m128i *)(dst + 48), _mm_loadu_si128((const __m128i *)(src + 48)));
+  }
+  for (; size >= 16; size -= 16, src += 16, dst += 16) {
+    _mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+  }
+
+  memcpy(dst, src, size);
+}
+
+__attribute__((target("sse2")))
+static void fill_row_sse2(uint8_t *dst, unsigned int pixel, int bpp, int width)
+{
+  __m128i p;
+  int size = 0;
+
+  if (bpp == 3) {
+    fill_row_scalar(dst, pixel, bpp, width);
+    return;
+  }
+
+  p = bpp == 1 ? _mm_set1_epi8(pixel) : bpp == 2 ? _mm_set1_epi16(pixel) : _mm_set1_epi32(pixel);
+
+  for (size = width * bpp; size >= 16; size -= 16, dst += 16) {
+    _mm_storeu_si128((__m128i *)dst, p);
+  }
+
+  fill_row_scalar(dst, pixel, bpp, size / bpp);
+}
+
+__attribute__((target("avx2")))
+static void convert_rgb565_avx2(uint8_t *dst, const uint8_t *src, int count)
+{
+  const __m256i r = _mm256_set1_epi32(0xF8), g = _mm256_set1_epi32(0xFC00), b = _mm256_set1_epi32(0xF80000);
+  __m256i p0, p1;
+  int i = 0;
+
+  for (i = 0; i + 16 <= count; i += 16, src += 64, dst += 32) {
+    p0 = _mm256_loadu_si256((const __m256i *)src);
+    p1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+    p0 = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(p0, r), 8), _mm256_srli_epi32(_mm256_and_si256(p0, g), 5)), _mm256_srli_epi32(_mm256_and_si256(p0, b), 19));
+    p1 = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(p1, r), 8), _mm256_srli_epi32(_mm256_and_si256(p1, g), 5)), _mm256_srli_epi32(_mm256_and_si256(p1, b), 19));
+    /* the pack works in 128 bits lanes, the quadwords are put back in order */
+    p0 = _mm256_permute4x64_epi64(_mm256_packus_epi32(p0, p1), 0xD8);
+    _mm256_storeu_si256((__m256i *)dst, p0);
+  }
+
+  convert_rgb565_sse2(dst, src, count - i);
+}
+
+/* 8 pixels are packed to 12 bytes in each lane, then the lanes are joined in the low 24 bytes */
+__attribute__((target("avx2")))
+static void convert_24_avx2(uint8_t *dst, const uint8_t *src, int count, __m256i shuffle, void (*convert)(uint8_t *, const uint8_t *, int))
+{
+  const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+  __m256i p;
+  int i = 0;
+
+  for (i = 0; i + 8 <= count; i += 8, src += 32, dst += 24) {
+    p = _mm256_loadu_si256((const __m256i *)src);
+    p = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p, shuffle), join);
+    _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(p));
+    _mm_storel_epi64((__m128i *)(dst + 16), _mm256_extracti128_si256(p, 1));
+  }
+
+  convert(dst, src, count - i);
+}
+
+__attribute__((target("avx2")))
+static void convert_rgb888_avx2(uint8_t *dst, const uint8_t *src, int count)
+{
+  convert_24_avx2(dst, src, count, _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1), convert_rgb888_scalar);
+}
+
+__attribute__((target("avx2")))
+static void convert_bgr888_avx2(uint8_t *dst, const uint8_t *src, int count)
+{
+  convert_24_avx2(dst, src, count, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1), convert_bgr888_scalar);
+}
+
+__attribute__((target("avx2")))
+static void convert_xrgb8888_avx2(uint8_t *dst, const uint8_t *src, int count)
+{
+  const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1, 2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+  const __m256i x = _mm256_set1_epi32(0xFF000000);
+  __m256i p;
+  int i = 0;
+
+  for (i = 0; i + 8 <= count; i += 8, src += 32, dst += 32) {
+    p = _mm256_loadu_si256((const __m256i *)src);
+    _mm256_storeu_si256((__m256i *)dst, _mm256_or_si256(_mm256_shuffle_epi8(p, shuffle), x));
+  }
+
+  convert_xrgb8888_scalar(dst, src, count - i);
+}
+
+__attribute__((target("avx2")))
+static void copy_row_avx2(uint8_t *dst, const uint8_t *src, int size)
+{
+  for (; size >= 128; size -= 128, src += 128, dst += 128) {
+    _mm256_storeu_si256((__m256i *)dst, _mm256_loadu_si256((const __m256i *)src));
+    _mm256_storeu_si256((__m256i *)(dst + 32), _mm256_loadu_si256((const __m256i *)(src + 32)));
+    _mm256_storeu_si256((__m256i *)(dst + 64), _mm256_loadu_si256((const __m256i *)(src + 64)));
+    _mm256_storeu_si256((__m256i *)(dst + 96), _mm256_loadu_si256((const __m256i *)(src + 96)));
+  }
+  for (; size >= 32; size -= 32, src += 32, dst += 32) {
+    _mm256_storeu_si256((__m256i *)dst, _mm256_loadu_si256((const __m256i *)src));
+  }
+
+  copy_row_sse2(dst, src, size);
+}
+
+__attribute__((target("avx2")))
+static void fill_row_avx2(uint8_t *dst, unsigned int pixel, int bpp, int width)
+{
+  __m256i p;
+  int size = 0;
+
+  if (bpp == 3) {
+    fill_row_scalar(dst, pixel, bpp, width);
+    return;
+  }
+
+  p = bpp == 1 ? _mm256_set1_epi8(pixel) : bpp == 2 ? _mm256_set1_epi16(pixel) : _mm256_set1_epi32(pixel);
+
+  for (size = width * bpp; size >= 32; size -= 32, dst += 32) {
+    _mm256_storeu_si256((__m256i *)dst, p);
+  }
+
+  fill_row_sse2(dst, pixel, bpp, size / bpp);
+}
+
+#endif
+
+#ifdef __ARM_NEON
+
+static void convert_rgb565_neon(uint8_t *dst, const uint8_t *src, int count)
+{
+  uint8x8x4_t p;
+  uint16x8_t v;
+  int i = 0;
+
+  for (i = 0; i + 8 <= count; i += 8, src += 32, dst += 16) {
+    p = vld4_u8(src);
+    v = vshll_n_u8(p.val[0], 8);
+    v = vsriq_n_u16(v, vshll_n_u8(p.val[1], 8), 5);
+    v = vsriq_n_u16(v, vshll_n_u8(p.val[2], 8), 11);
+    vst1q_u8(dst, vreinterpretq_u8_u16(v));
+  }
+
+  convert_rgb565_scalar(dst, src, count - i);
+}
+
+static void convert_rgb888_neon(uint8_t *dst, const uint8_t *src, int count)
+{
+  uint8x16x4_t p;
+  uint8x16x3_t v;
+  int i = 0;
+
+  for (i = 0; i + 16 <= count; i += 16, src += 64, dst += 48) {
+    p = vld4q_u8(src);
+    v.val[0] = p.val[0];
+    v.val[1] = p.val[1];
+    v.val[2] = p.val[2];
+    vst3q_u8(dst, v);
+  }
+
+  convert_rgb888_scalar(dst, src, count - i);
+}
+
+static void convert_bgr888_neon(uint8_t *dst, const uint8_t *src, int count)
+{
+  uint8x16x4_t p;
+  uint8x16x3_t v;
+  int i = 0;
+
+  for (i = 0; i + 16 <= count; i += 16, src += 64, dst += 48) {
+    p = vld4q_u8(src);
+    v.val[0] = p.val[2];
+    v.val[1] = p.val[1];
+    v.val[2] = p.val[0];
+    vst3q_u8(dst, v);
+  }
+
+  convert_bgr888_scalar(dst, src, count - i);
+}
+
+static void convert_xrgb8888_neon(uint8_t *dst, const uint8_t *src, int count)
+{
+  uint8x16x4_t p;
+  uint8x16_t r;
+  int i = 0;
+
+  for (i = 0; i + 16 <= count; i += 16, src += 64, dst += 64) {
+    p = vld4q_u8(src);
+    r = p.val[0];
+    p.val[0] = p.val[2];
+    p.val[2] = r;
+    p.val[3] = vdupq_n_u8(0xFF);
+    vst4q_u8(dst, p);
+  }
+
+  convert_xrgb8888_scalar(dst, src, count - i);
+}
+
+static void copy_row_neon(uint8_t *dst, const uint8_t *src, int size)
+{
+  for (; size >= 64; size -= 64, src += 64, dst += 64) {
+    vst1q_u8(dst, vld1q_u8(src));
+    vst1q_u8(dst + 16, vld1q_u8(src + 16));
+    vst1q_u8(dst + 32, vld1q_u8(src + 32));
+    vst1q_u8(dst + 48, vld1q_u8(src + 48));
+  }
+  for (; size >= 16; size -= 16, src += 16, dst += 16) {
+    vst1q_u8(dst, vld1q_u8(src));
+  }
+
+  memcpy(dst, src, size);
+}
+
+static void fill_row_neon(uint8_t *dst, unsigned int pixel, int bpp, int width)
+{
+  uint8x16_t p;
+  int size = 0;
+
+  if (bpp == 3) {
+    fill_row_scalar(dst, pixel, bpp, width);
+    return;
+  }
+
+  p = bpp == 1 ? vdupq_n_u8(pixel) : bpp == 2 ? vreinterpretq_u8_u16(vdupq_n_u16(pixel)) : vreinterpretq_u8_u32(vdupq_n_u32(pixel));
+
+  for (size = width * bpp; size >= 16; size -= 16, dst += 16) {
+    vst1q_u8(dst, p);
+  }
+
+  fill_row_scalar(dst, pixel, bpp, size / bpp);
+}
+
+#endif
+
+static const struct blit_kernels blit_kernels[BLIT_ISAS] = {
+  [ BLIT_SCALAR ] = { { convert_rgb565_scalar, convert_rgb888_scalar, convert_bgr888_scalar, convert_xrgb8888_scalar }, copy_row_scalar, fill_row_scalar },
+#ifdef BLIT_X86
+  [ BLIT_SSE2 ] = { { convert_rgb565_sse2, convert_rgb888_scalar, convert_bgr888_scalar, convert_xrgb8888_sse2 }, copy_row_sse2, fill_row_sse2 },
+  [ BLIT_AVX2 ] = { { convert_rgb565_avx2, convert_rgb888_avx2, convert_bgr888_avx2, convert_xrgb8888_avx2 }, copy_row_avx2, fill_row_avx2 },
+#endif
+#ifdef __ARM_NEON
+  [ BLIT_NEON ] = { { convert_rgb565_neon, convert_rgb888_neon, convert_bgr888_neon, convert_xrgb8888_neon }, copy_row_neon, fill_row_neon },
+#endif
+};
+
+static int blit_isa_supported[BLIT_ISAS];
+static int blit_isa_current = BLIT_SCALAR;
+static pthread_once_t blit_once = PTHREAD_ONCE_INIT;
+
+static void blit_detect()
+{
+  blit_isa_supported[BLIT_SCALAR] = 1;
+
+#ifdef BLIT_X86
+  __builtin_cpu_init();
+  blit_isa_supported[BLIT_SSE2] = __builtin_cpu_supports("sse2");
+  blit_isa_supported[BLIT_AVX2] = __builtin_cpu_supports("avx2");
+#endif
+#ifdef __ARM_NEON
+  blit_isa_supported[BLIT_NEON] = 1;
+#endif
+
+  for (blit_isa_current = BLIT_ISAS - 1; !blit_isa_supported[blit_isa_current]; blit_isa_current--);
+}
+
+int blit_isa()
+{
+  pthread_once(&blit_once, blit_detect);
+
+  return blit_isa_current;
+}
+
+int blit_set_isa(int isa)
+{
+  pthread_once(&blit_once, blit_detect);
+
+  if (isa < 0 || isa >= BLIT_ISAS || !blit_isa_supported[isa]) {
+    return -1;
+  }
+
+  blit_isa_current = isa;
+
+  return 0;
+}
+
+void blit_convert(int format, void *dst, const void *src, int count)
+{
+  pthread_once(&blit_once, blit_detect);
+
+  blit_kernels[blit_isa_current].convert[format](dst, src, count);
+}
+
+void blit_copy(void *dst, int dst_stride, const void *src, int src_stride, int width, int height)
+{
+  int i = 0;
+
+  pthread_once(&blit_once, blit_detect);
+
+  for (i = 0; i < height; i++) {
+    blit_kernels[blit_isa_current].copy_row((uint8_t *)dst + i * dst_stride, (const uint8_t *)src + i * src_stride, width);
+  }
+}
+
+void blit_fill(void *dst, int dst_stride, unsigned int pixel, int bpp, int width, int height)
+{
+  int i = 0;
+
+  pthread_once(&blit_once, blit_detect);
+
+  for (i = 0; i < height; i++) {
+    blit_kernels[blit_isa_current].fill_row((uint8_t *)dst + i * dst_stride, pixel, bpp, width);
+  }
+}
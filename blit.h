@@ -0,0 +1,63 @@
+/*
+  TinyGLUT                 Small implementation of GLUT (OpenGL Utility Toolkit)
+  Copyright (c) 2015-2024, Nicolas Caramelli
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BLIT_H
+#define BLIT_H
+
+/* framebuffer pixel formats, by their layout in memory */
+enum {
+  BLIT_RGB565,   /* 16 bits, red in the high bits */
+  BLIT_RGB888,   /* bytes R, G, B */
+  BLIT_BGR888,   /* bytes B, G, R */
+  BLIT_XRGB8888, /* bytes B, G, R, X */
+  BLIT_FORMATS
+};
+
+/* kernels selected at runtime from the CPU features */
+enum {
+  BLIT_SCALAR,
+  BLIT_SSE2,
+  BLIT_AVX2,
+  BLIT_NEON,
+  BLIT_ISAS
+};
+
+/* the kernels in use, the best supported by default */
+int blit_isa();
+
+/* returns -1 if the kernels are not supported by the CPU */
+int blit_set_isa(int isa);
+
+/* convert count RGBA8888 pixels (bytes R, G, B, A) to a framebuffer format */
+void blit_convert(int format, void *dst, const void *src, int count);
+
+/* copy a rectangle of width bytes */
+void blit_copy(void *dst, int dst_stride, const void *src, int src_stride, int width, int height);
+
+/* fill a rectangle of width pixels of bpp bytes */
+void blit_fill(void *dst, int dst_stride, unsigned int pixel, int bpp, int width, int height);
+
+#endif
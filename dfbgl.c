@@ -26,6 +26,7 @@
 
 #include <directfbgl.h>
 #include "attributes.h"
+#include "event.h"
 
 #ifdef FIU_ENABLE
 #include <fiu-local.h>
@@ -43,7 +44,8 @@ int init(int *width, int *height, int *err);
 int create_window(int dpy, int posx, int posy, int width, int height, int opt, int *err);
 void destroy_window(int dpy, int win);
 void fini(int dpy);
-int get_event(int dpy, int *type, int *key, int *x, int *y);
+int get_events(int dpy, struct event *events, int count);
+int get_event_fd(int dpy);
 
 typedef struct {
   IDirectFB *directfb_dpy;
@@ -241,9 +243,16 @@ void Fini(int display)
   free(glut_dpy);
 }
 
-int GetEvent(int display, int *type, int *key, int *x, int *y)
+int GetEvents(int display, struct event *events, int count)
 {
   glutDisplay *glut_dpy = (glutDisplay *)(long)display;
 
-  return get_event((long)glut_dpy->directfb_dpy, type, key, x, y);
+  return get_events((long)glut_dpy->directfb_dpy, events, count);
+}
+
+int GetEventFd(int display)
+{
+  glutDisplay *glut_dpy = (glutDisplay *)(long)display;
+
+  return get_event_fd((long)glut_dpy->directfb_dpy);
 }
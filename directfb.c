@@ -24,12 +24,15 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <fcntl.h>
+#include <unistd.h>
 #include <directfb.h>
 #include "event.h"
 #include "keys.h"
 
 typedef struct {
   IDirectFBEventBuffer *event_buffer;
+  int event_fd;
   IDirectFBDisplayLayer *layer;
 } DFBPrivate;
 
@@ -65,12 +68,22 @@ int init(int *width, int *height, int *err)
 
   dfb->refs = (long)private;
 
+  private->event_fd = -1;
+
   ret = dfb->CreateEventBuffer(dfb, &private->event_buffer);
   if (ret) {
     printf("CreateEventBuffer failed: %s\n", DirectFBErrorString(ret));
     goto fail;
   }
 
+  ret = private->event_buffer->CreateFileDescriptor(private->event_buffer, &private->event_fd);
+  if (ret) {
+    printf("CreateFileDescriptor failed: %s\n", DirectFBErrorString(ret));
+    goto fail;
+  }
+
+  fcntl(private->event_fd, F_SETFL, fcntl(private->event_fd, F_GETFL) | O_NONBLOCK);
+
   ret = dfb->GetDisplayLayer(dfb, DLID_PRIMARY, &private->layer);
   if (ret) {
     printf("GetDisplayLayer failed: %s\n", DirectFBErrorString(ret));
@@ -96,6 +109,12 @@ fail:
     if (private->layer) {
       private->layer->Release(private->layer);
     }
+    if (private->event_fd != -1) {
+      close(private->event_fd);
+    }
+    if (private->event_buffer) {
+      private->event_buffer->Release(private->event_buffer);
+    }
     free(private);
   }
   if (dfb) {
@@ -203,74 +222,91 @@ void fini(int dpy)
   DFBPrivate *private = (DFBPrivate *)(long)dfb->refs;
 
   private->layer->Release(private->layer);
+  close(private->event_fd);
   private->event_buffer->Release(private->event_buffer);
   free(private);
   dfb->Release(dfb);
 }
 
-int get_event(int dpy, int *type, int *key, int *x, int *y)
+int get_events(int dpy, struct event *events, int count)
 {
   IDirectFB *dfb = (IDirectFB *)(long)dpy;
   DFBPrivate *private = (DFBPrivate *)(long)dfb->refs;
   IDirectFBWindow *window = NULL;
-  DFBWindowEvent event;
+  DFBEvent buffer_event;
+  DFBWindowEvent *event = &buffer_event.window;
   DFBWindowProperty *property = NULL;
-  int win = 0;
-
-  *type = EVENT_NONE;
-  *key = *x = *y = 0;
-
-  memset(&event, 0, sizeof(DFBWindowEvent));
-  if (!private->event_buffer->GetEvent(private->event_buffer, (DFBEvent *)&event)) {
-    private->layer->GetWindow(private->layer, event.window_id, &window);
+  int key = 0, n = 0;
+
+  while (n < count && read(private->event_fd, &buffer_event, sizeof(DFBEvent)) == sizeof(DFBEvent)) {
+    memset(&events[n], 0, sizeof(struct event));
+    window = NULL;
+    property = NULL;
+    private->layer->GetWindow(private->layer, event->window_id, &window);
+    if (!window) {
+      continue;
+    }
     window->GetProperty(window, "property", (void *)&property);
-    if (event.type == DWET_GOTFOCUS) {
+    if (!property) {
+      continue;
+    }
+    events[n].win = (long)property->surface;
+    if (event->type == DWET_GOTFOCUS) {
       if (!property->expose) {
         property->expose = 1;
         window->SetProperty(window, "property", property, NULL);
-        *type = EVENT_DISPLAY;
+        events[n].type = EVENT_DISPLAY;
       }
     }
-    else if (event.type == DWET_KEYDOWN) {
-      switch (event.key_symbol) {
-        case DIKS_F1:           *key = F1;        break;
-        case DIKS_F2:           *key = F2;        break;
-        case DIKS_F3:           *key = F3;        break;
-        case DIKS_F4:           *key = F4;        break;
-        case DIKS_F5:           *key = F5;        break;
-        case DIKS_F6:           *key = F6;        break;
-        case DIKS_F7:           *key = F7;        break;
-        case DIKS_F8:           *key = F8;        break;
-        case DIKS_F9:           *key = F9;        break;
-        case DIKS_F10:          *key = F10;       break;
-        case DIKS_F11:          *key = F11;       break;
-        case DIKS_F12:          *key = F12;       break;
-        case DIKS_CURSOR_LEFT:  *key = LEFT;      break;
-        case DIKS_CURSOR_UP:    *key = UP;        break;
-        case DIKS_CURSOR_RIGHT: *key = RIGHT;     break;
-        case DIKS_CURSOR_DOWN:  *key = DOWN;      break;
-        case DIKS_PAGE_UP:      *key = PAGE_UP;   break;
-        case DIKS_PAGE_DOWN:    *key = PAGE_DOWN; break;
-        default:                *key = 0;         break;
+    else if (event->type == DWET_KEYDOWN) {
+      switch (event->key_symbol) {
+        case DIKS_F1:           key = F1;         break;
+        case DIKS_F2:           key = F2;         break;
+        case DIKS_F3:           key = F3;         break;
+        case DIKS_F4:           key = F4;         break;
+        case DIKS_F5:           key = F5;         break;
+        case DIKS_F6:           key = F6;         break;
+        case DIKS_F7:           key = F7;         break;
+        case DIKS_F8:           key = F8;         break;
+        case DIKS_F9:           key = F9;         break;
+        case DIKS_F10:          key = F10;        break;
+        case DIKS_F11:          key = F11;        break;
+        case DIKS_F12:          key = F12;        break;
+        case DIKS_CURSOR_LEFT:  key = LEFT;       break;
+        case DIKS_CURSOR_UP:    key = UP;         break;
+        case DIKS_CURSOR_RIGHT: key = RIGHT;      break;
+        case DIKS_CURSOR_DOWN:  key = DOWN;       break;
+        case DIKS_PAGE_UP:      key = PAGE_UP;    break;
+        case DIKS_PAGE_DOWN:    key = PAGE_DOWN;  break;
+        default:                key = 0;          break;
       }
-      if (!*key) {
-        *key = event.key_symbol;
-        *type = EVENT_KEYBOARD;
+      if (!key) {
+        events[n].key = event->key_symbol;
+        events[n].type = EVENT_KEYBOARD;
       }
       else {
-        *type = EVENT_SPECIAL;
+        events[n].key = key;
+        events[n].type = EVENT_SPECIAL;
       }
     }
-    else if (event.type == DWET_MOTION) {
-      *x = event.x;
-      *y = event.y;
-      *type = EVENT_PASSIVEMOTION;
+    else if (event->type == DWET_MOTION) {
+      events[n].x = event->x;
+      events[n].y = event->y;
+      events[n].type = EVENT_PASSIVEMOTION;
     }
-  }
 
-  if (*type) {
-    win = (long)property->surface;
+    if (events[n].type) {
+      n++;
+    }
   }
 
-  return win;
+  return n;
+}
+
+int get_event_fd(int dpy)
+{
+  IDirectFB *dfb = (IDirectFB *)(long)dpy;
+  DFBPrivate *private = (DFBPrivate *)(long)dfb->refs;
+
+  return private->event_fd;
 }
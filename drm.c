@@ -0,0 +1,668 @@
+/*
+  TinyGLUT                 Small implementation of GLUT (OpenGL Utility Toolkit)
+  Copyright (c) 2015-2024, Nicolas Caramelli
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gbm.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include "event.h"
+
+/* one fullscreen window per output, scanned out from the primary plane */
+#define WINDOW 1
+
+struct drm_window {
+  struct gbm_surface *surface;
+  struct gbm_bo *current; /* scanned out */
+  struct gbm_bo *pending; /* flip requested */
+  struct gbm_bo *queued; /* swapped while a flip is pending */
+  int expose;
+};
+
+/* the display handle is the user data */
+struct drm_user_data {
+  int fd;
+  struct gbm_device *gbm;
+  uint32_t connector_id, crtc_id, plane_id;
+  drmModeModeInfo mode;
+  uint32_t mode_blob;
+  drmModeCrtc *saved_crtc;
+  /* property ids */
+  uint32_t connector_crtc_id;
+  uint32_t crtc_mode_id, crtc_active;
+  uint32_t plane_fb_id, plane_crtc_id, plane_src_x, plane_src_y, plane_src_w, plane_src_h, plane_crtc_x, plane_crtc_y, plane_crtc_w, plane_crtc_h;
+  struct drm_window *window;
+  int modeset;
+  pthread_mutex_t flip_mutex; /* swaps may come from the render threads */
+};
+
+static uint32_t property_id(int fd, uint32_t object_id, uint32_t object_type, const char *name, uint64_t *value)
+{
+  drmModeObjectProperties *props = NULL;
+  drmModePropertyRes *prop = NULL;
+  uint32_t id = 0, i = 0;
+
+  props = drmModeObjectGetProperties(fd, object_id, object_type);
+  if (!props) {
+    return 0;
+  }
+
+  for (i = 0; i < props->count_props && !id; i++) {
+    prop = drmModeGetProperty(fd, props->props[i]);
+    if (!prop) {
+      continue;
+    }
+    if (!strcmp(prop->name, name)) {
+      id = prop->prop_id;
+      if (value) {
+        *value = props->prop_values[i];
+      }
+    }
+    drmModeFreeProperty(prop);
+  }
+
+  drmModeFreeObjectProperties(props);
+
+  return id;
+}
+
+/* first connected connector, its preferred mode, a CRTC driving it and the primary plane of that CRTC */
+static int output_open(struct drm_user_data *user_data)
+{
+  drmModeRes *res = NULL;
+  drmModeConnector *connector = NULL;
+  drmModeEncoder *encoder = NULL;
+  drmModePlaneRes *plane_res = NULL;
+  drmModePlane *plane = NULL;
+  uint64_t type = 0;
+  int crtc_index = -1, i = 0, j = 0;
+
+  res = drmModeGetResources(user_data->fd);
+  if (!res) {
+    return -1;
+  }
+
+  for (i = 0; i < res->count_connectors; i++) {
+    connector = drmModeGetConnector(user_data->fd, res->connectors[i]);
+    if (connector && connector->connection == DRM_MODE_CONNECTED && connector->count_modes) {
+      break;
+    }
+    drmModeFreeConnector(connector);
+    connector = NULL;
+  }
+
+  if (!connector) {
+    drmModeFreeResources(res);
+    return -1;
+  }
+
+  user_data->connector_id = connector->connector_id;
+  user_data->mode = connector->modes[0];
+  for (i = 0; i < connector->count_modes; i++) {
+    if (connector->modes[i].type & DRM_MODE_TYPE_PREFERRED) {
+      user_data->mode = connector->modes[i];
+      break;
+    }
+  }
+
+  /* keep the CRTC already driving the connector, else the first one an encoder can drive */
+  if (connector->encoder_id) {
+    encoder = drmModeGetEncoder(user_data->fd, connector->encoder_id);
+    if (encoder) {
+      user_data->crtc_id = encoder->crtc_id;
+      drmModeFreeEncoder(encoder);
+    }
+  }
+  for (i = 0; i < connector->count_encoders && !user_data->crtc_id; i++) {
+    encoder = drmModeGetEncoder(user_data->fd, connector->encoders[i]);
+    if (!encoder) {
+      continue;
+    }
+    for (j = 0; j < res->count_crtcs; j++) {
+      if (encoder->possible_crtcs & (1 << j)) {
+        user_data->crtc_id = res->crtcs[j];
+        break;
+      }
+    }
+    drmModeFreeEncoder(encoder);
+  }
+
+  for (i = 0; i < res->count_crtcs; i++) {
+    if (res->crtcs[i] == user_data->crtc_id) {
+      crtc_index = i;
+    }
+  }
+
+  drmModeFreeConnector(connector);
+  drmModeFreeResources(res);
+
+  if (crtc_index == -1) {
+    return -1;
+  }
+
+  plane_res = drmModeGetPlaneResources(user_data->fd);
+  if (!plane_res) {
+    return -1;
+  }
+
+  for (i = 0; i < (int)plane_res->count_planes && !user_data->plane_id; i++) {
+    plane = drmModeGetPlane(user_data->fd, plane_res->planes[i]);
+    if (!plane) {
+      continue;
+    }
+    if (plane->possible_crtcs & (1 << crtc_index) && property_id(user_data->fd, plane->plane_id, DRM_MODE_OBJECT_PLANE, "type", &type) && type == DRM_PLANE_TYPE_PRIMARY) {
+      user_data->plane_id = plane->plane_id;
+    }
+    drmModeFreePlane(plane);
+  }
+
+  drmModeFreePlaneResources(plane_res);
+
+  return user_data->plane_id ? 0 : -1;
+}
+
+static int device_open(const char *path, struct drm_user_data *user_data)
+{
+  user_data->fd = open(path, O_RDWR | O_CLOEXEC);
+  if (user_data->fd == -1) {
+    return -1;
+  }
+
+  if (drmSetClientCap(user_data->fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) || drmSetClientCap(user_data->fd, DRM_CLIENT_CAP_ATOMIC, 1)) {
+    printf("%s: atomic modesetting not supported\n", path);
+    goto fail;
+  }
+
+  if (output_open(user_data) == -1) {
+    printf("%s: no connected output\n", path);
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  close(user_data->fd);
+  user_data->fd = -1;
+  user_data->connector_id = user_data->crtc_id = user_data->plane_id = 0;
+  return -1;
+}
+
+static void fb_destroy(struct gbm_bo *bo, void *data)
+{
+  drmModeRmFB(gbm_device_get_fd(gbm_bo_get_device(bo)), (uint32_t)(uintptr_t)data);
+}
+
+/* framebuffers are added once per buffer of the gbm surface and kept with it */
+static uint32_t fb_get(struct drm_user_data *user_data, struct gbm_bo *bo)
+{
+  uint32_t fb = (uint32_t)(uintptr_t)gbm_bo_get_user_data(bo);
+  uint32_t handles[4] = { 0 }, strides[4] = { 0 }, offsets[4] = { 0 };
+
+  if (fb) {
+    return fb;
+  }
+
+  handles[0] = gbm_bo_get_handle(bo).u32;
+  strides[0] = gbm_bo_get_stride(bo);
+  if (drmModeAddFB2(user_data->fd, gbm_bo_get_width(bo), gbm_bo_get_height(bo), gbm_bo_get_format(bo), handles, strides, offsets, &fb, 0)) {
+    printf("drmModeAddFB2 failed: %s\n", strerror(errno));
+    return 0;
+  }
+
+  gbm_bo_set_user_data(bo, (void *)(uintptr_t)fb, fb_destroy);
+
+  return fb;
+}
+
+/* the first commit sets the mode, the next ones only change the framebuffer of the primary plane */
+static int flip(struct drm_user_data *user_data, uint32_t fb, uint32_t flags)
+{
+  drmModeAtomicReq *req = NULL;
+  int ret = 0;
+
+  req = drmModeAtomicAlloc();
+  if (!req) {
+    return -1;
+  }
+
+  if (!user_data->modeset) {
+    drmModeAtomicAddProperty(req, user_data->connector_id, user_data->connector_crtc_id, user_data->crtc_id);
+    drmModeAtomicAddProperty(req, user_data->crtc_id, user_data->crtc_mode_id, user_data->mode_blob);
+    drmModeAtomicAddProperty(req, user_data->crtc_id, user_data->crtc_active, 1);
+    drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_crtc_id, user_data->crtc_id);
+    drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_src_x, 0);
+    drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_src_y, 0);
+    drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_src_w, user_data->mode.hdisplay << 16);
+    drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_src_h, user_data->mode.vdisplay << 16);
+    drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_crtc_x, 0);
+    drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_crtc_y, 0);
+    drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_crtc_w, user_data->mode.hdisplay);
+    drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_crtc_h, user_data->mode.vdisplay);
+    flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
+  }
+  drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_fb_id, fb);
+
+  ret = drmModeAtomicCommit(user_data->fd, req, flags, user_data);
+  if (!ret) {
+    user_data->modeset = 1;
+  }
+
+  drmModeAtomicFree(req);
+
+  return ret;
+}
+
+/* non-blocking flip to a locked buffer, released if it cannot be presented */
+static void present(struct drm_user_data *user_data, struct gbm_bo *bo)
+{
+  struct drm_window *window = user_data->window;
+  uint32_t fb = 0;
+
+  fb = fb_get(user_data, bo);
+  if (!fb) {
+    gbm_surface_release_buffer(window->surface, bo);
+    return;
+  }
+
+  if (flip(user_data, fb, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT)) {
+    printf("drmModeAtomicCommit failed: %s\n", strerror(errno));
+    gbm_surface_release_buffer(window->surface, bo);
+    return;
+  }
+
+  window->pending = bo;
+}
+
+/* the completed flip releases the buffer it replaced and presents the queued one */
+static void page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec, void *data)
+{
+  struct drm_user_data *user_data = data;
+  struct drm_window *window = user_data->window;
+
+  if (!window || !window->pending) {
+    return;
+  }
+
+  if (window->current) {
+    gbm_surface_release_buffer(window->surface, window->current);
+  }
+  window->current = window->pending;
+  window->pending = NULL;
+
+  if (window->queued) {
+    present(user_data, window->queued);
+    window->queued = NULL;
+  }
+}
+
+/* called with flip_mutex held, the fd is checked first as drmHandleEvent blocks on an empty queue */
+static int events_dispatch(struct drm_user_data *user_data, int timeout)
+{
+  drmEventContext context;
+  struct pollfd pfd;
+
+  pfd.fd = user_data->fd;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, timeout) <= 0) {
+    return 0;
+  }
+
+  memset(&context, 0, sizeof(drmEventContext));
+  context.version = 2;
+  context.page_flip_handler = page_flip_handler;
+
+  return drmHandleEvent(user_data->fd, &context);
+}
+
+/* blocking commit turning the output off, before the scanned out buffers are released */
+static void output_off(struct drm_user_data *user_data)
+{
+  drmModeAtomicReq *req = NULL;
+
+  if (!user_data->modeset) {
+    return;
+  }
+
+  req = drmModeAtomicAlloc();
+  if (!req) {
+    return;
+  }
+
+  drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_fb_id, 0);
+  drmModeAtomicAddProperty(req, user_data->plane_id, user_data->plane_crtc_id, 0);
+  drmModeAtomicAddProperty(req, user_data->connector_id, user_data->connector_crtc_id, 0);
+  drmModeAtomicAddProperty(req, user_data->crtc_id, user_data->crtc_mode_id, 0);
+  drmModeAtomicAddProperty(req, user_data->crtc_id, user_data->crtc_active, 0);
+  if (drmModeAtomicCommit(user_data->fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL)) {
+    printf("drmModeAtomicCommit failed: %s\n", strerror(errno));
+  }
+
+  drmModeAtomicFree(req);
+
+  user_data->modeset = 0;
+}
+
+int init(int *width, int *height, int *err)
+{
+  struct drm_user_data *user_data = NULL;
+  char path[32];
+  int i = 0;
+
+  user_data = calloc(1, sizeof(struct drm_user_data));
+  if (!user_data) {
+    printf("drm_user_data calloc failed\n");
+    goto fail;
+  }
+  else {
+    user_data->fd = -1;
+    pthread_mutex_init(&user_data->flip_mutex, NULL);
+  }
+
+  if (getenv("DRM_DEVICE")) {
+    if (device_open(getenv("DRM_DEVICE"), user_data) == -1) {
+      printf("open %s failed\n", getenv("DRM_DEVICE"));
+      goto fail;
+    }
+  }
+  else {
+    for (i = 0; i < DRM_MAX_MINOR; i++) {
+      snprintf(path, sizeof(path), DRM_DEV_NAME, DRM_DIR_NAME, i);
+      if (!device_open(path, user_data)) {
+        break;
+      }
+    }
+    if (user_data->fd == -1) {
+      printf("no DRM device found\n");
+      goto fail;
+    }
+  }
+
+  user_data->connector_crtc_id = property_id(user_data->fd, user_data->connector_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID", NULL);
+  user_data->crtc_mode_id = property_id(user_data->fd, user_data->crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID", NULL);
+  user_data->crtc_active = property_id(user_data->fd, user_data->crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE", NULL);
+  user_data->plane_fb_id = property_id(user_data->fd, user_data->plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID", NULL);
+  user_data->plane_crtc_id = property_id(user_data->fd, user_data->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_ID", NULL);
+  user_data->plane_src_x = property_id(user_data->fd, user_data->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_X", NULL);
+  user_data->plane_src_y = property_id(user_data->fd, user_data->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_Y", NULL);
+  user_data->plane_src_w = property_id(user_data->fd, user_data->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_W", NULL);
+  user_data->plane_src_h = property_id(user_data->fd, user_data->plane_id, DRM_MODE_OBJECT_PLANE, "SRC_H", NULL);
+  user_data->plane_crtc_x = property_id(user_data->fd, user_data->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_X", NULL);
+  user_data->plane_crtc_y = property_id(user_data->fd, user_data->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_Y", NULL);
+  user_data->plane_crtc_w = property_id(user_data->fd, user_data->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_W", NULL);
+  user_data->plane_crtc_h = property_id(user_data->fd, user_data->plane_id, DRM_MODE_OBJECT_PLANE, "CRTC_H", NULL);
+  if (!user_data->connector_crtc_id || !user_data->crtc_mode_id || !user_data->crtc_active || !user_data->plane_fb_id || !user_data->plane_crtc_id || !user_data->plane_src_x || !user_data->plane_src_y || !user_data->plane_src_w || !user_data->plane_src_h || !user_data->plane_crtc_x || !user_data->plane_crtc_y || !user_data->plane_crtc_w || !user_data->plane_crtc_h) {
+    printf("atomic properties not found\n");
+    goto fail;
+  }
+
+  if (drmModeCreatePropertyBlob(user_data->fd, &user_data->mode, sizeof(drmModeModeInfo), &user_data->mode_blob)) {
+    printf("drmModeCreatePropertyBlob failed: %s\n", strerror(errno));
+    goto fail;
+  }
+
+  user_data->saved_crtc = drmModeGetCrtc(user_data->fd, user_data->crtc_id);
+
+  user_data->gbm = gbm_create_device(user_data->fd);
+  if (!user_data->gbm) {
+    printf("gbm_create_device failed\n");
+    goto fail;
+  }
+
+  *width = user_data->mode.hdisplay;
+  *height = user_data->mode.vdisplay;
+
+  *err = 0;
+
+  return (long)user_data;
+
+fail:
+  if (user_data) {
+    if (user_data->gbm) {
+      gbm_device_destroy(user_data->gbm);
+    }
+    if (user_data->saved_crtc) {
+      drmModeFreeCrtc(user_data->saved_crtc);
+    }
+    if (user_data->mode_blob) {
+      drmModeDestroyPropertyBlob(user_data->fd, user_data->mode_blob);
+    }
+    if (user_data->fd != -1) {
+      close(user_data->fd);
+    }
+    pthread_mutex_destroy(&user_data->flip_mutex);
+    free(user_data);
+  }
+  *err = -1;
+  return 0;
+}
+
+int create_window(int dpy, int posx, int posy, int width, int height, int opt, int *err)
+{
+  struct drm_user_data *user_data = (struct drm_user_data *)(long)dpy;
+  struct drm_window *window = NULL;
+
+  if (user_data->window) {
+    printf("only one window per output\n");
+    goto fail;
+  }
+
+  window = calloc(1, sizeof(struct drm_window));
+  if (!window) {
+    printf("drm_window calloc failed\n");
+    goto fail;
+  }
+
+  /* the window covers the output whatever its requested position and size */
+  window->surface = gbm_surface_create(user_data->gbm, user_data->mode.hdisplay, user_data->mode.vdisplay, GBM_FORMAT_XRGB8888, GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+  if (!window->surface) {
+    printf("gbm_surface_create failed\n");
+    goto fail;
+  }
+
+  pthread_mutex_lock(&user_data->flip_mutex);
+  user_data->window = window;
+  pthread_mutex_unlock(&user_data->flip_mutex);
+
+  *err = 0;
+
+  return WINDOW;
+
+fail:
+  if (window) {
+    free(window);
+  }
+  *err = -1;
+  return 0;
+}
+
+void destroy_window(int dpy, int win)
+{
+  struct drm_user_data *user_data = (struct drm_user_data *)(long)dpy;
+  struct drm_window *window = NULL;
+
+  if (win != WINDOW) {
+    return;
+  }
+
+  pthread_mutex_lock(&user_data->flip_mutex);
+
+  window = user_data->window;
+  if (!window) {
+    pthread_mutex_unlock(&user_data->flip_mutex);
+    return;
+  }
+
+  /* only the teardown waits for the pending flip, its buffer is scanned out until the output is off */
+  if (window->queued) {
+    gbm_surface_release_buffer(window->surface, window->queued);
+    window->queued = NULL;
+  }
+  while (window->pending && events_dispatch(user_data, -1) != -1);
+  output_off(user_data);
+  user_data->window = NULL;
+
+  pthread_mutex_unlock(&user_data->flip_mutex);
+
+  if (window->pending) {
+    gbm_surface_release_buffer(window->surface, window->pending);
+  }
+  if (window->current) {
+    gbm_surface_release_buffer(window->surface, window->current);
+  }
+  gbm_surface_destroy(window->surface);
+  free(window);
+}
+
+void fini(int dpy)
+{
+  struct drm_user_data *user_data = (struct drm_user_data *)(long)dpy;
+
+  destroy_window(dpy, WINDOW);
+
+  if (user_data->saved_crtc) {
+    if (user_data->saved_crtc->mode_valid) {
+      drmModeSetCrtc(user_data->fd, user_data->saved_crtc->crtc_id, user_data->saved_crtc->buffer_id, user_data->saved_crtc->x, user_data->saved_crtc->y, &user_data->connector_id, 1, &user_data->saved_crtc->mode);
+    }
+    drmModeFreeCrtc(user_data->saved_crtc);
+  }
+
+  gbm_device_destroy(user_data->gbm);
+  drmModeDestroyPropertyBlob(user_data->fd, user_data->mode_blob);
+  close(user_data->fd);
+
+  pthread_mutex_destroy(&user_data->flip_mutex);
+
+  free(user_data);
+}
+
+/* the flip events, read from the DRM fd, only release and present the buffers, the frames are scheduled from the refresh rate */
+int get_events(int dpy, struct event *events, int count)
+{
+  struct drm_user_data *user_data = (struct drm_user_data *)(long)dpy;
+  struct drm_window *window = NULL;
+  int n = 0;
+
+  pthread_mutex_lock(&user_data->flip_mutex);
+
+  events_dispatch(user_data, 0);
+
+  window = user_data->window;
+  if (window && !window->expose && count) {
+    memset(&events[n], 0, sizeof(struct event));
+    events[n].win = WINDOW;
+    events[n].type = EVENT_DISPLAY;
+    window->expose = 1;
+    n++;
+  }
+
+  pthread_mutex_unlock(&user_data->flip_mutex);
+
+  return n;
+}
+
+int get_event_fd(int dpy)
+{
+  struct drm_user_data *user_data = (struct drm_user_data *)(long)dpy;
+
+  return user_data->fd;
+}
+
+int get_refresh_rate(int dpy)
+{
+  struct drm_user_data *user_data = (struct drm_user_data *)(long)dpy;
+
+  if (!user_data->mode.htotal || !user_data->mode.vtotal) {
+    return 0;
+  }
+
+  /* clock in kHz, refresh rate in mHz */
+  return (long long)user_data->mode.clock * 1000000 / (user_data->mode.htotal * user_data->mode.vtotal);
+}
+
+/* presents the front buffer with a non-blocking atomic flip, or queues it while the previous flip is pending,
+   a buffer still queued at the next swap is released without being scanned out so the swaps never wait */
+void swap_window(int dpy, int win)
+{
+  struct drm_user_data *user_data = (struct drm_user_data *)(long)dpy;
+  struct drm_window *window = NULL;
+  struct gbm_bo *bo = NULL;
+
+  if (win != WINDOW) {
+    return;
+  }
+
+  pthread_mutex_lock(&user_data->flip_mutex);
+
+  window = user_data->window;
+  if (!window) {
+    goto out;
+  }
+
+  bo = gbm_surface_lock_front_buffer(window->surface);
+  if (!bo) {
+    printf("gbm_surface_lock_front_buffer failed\n");
+    goto out;
+  }
+
+  if (window->pending) {
+    if (window->queued) {
+      gbm_surface_release_buffer(window->surface, window->queued);
+    }
+    window->queued = bo;
+  }
+  else {
+    present(user_data, bo);
+  }
+
+out:
+  pthread_mutex_unlock(&user_data->flip_mutex);
+}
+
+void *get_native_display(int dpy)
+{
+  struct drm_user_data *user_data = (struct drm_user_data *)(long)dpy;
+
+  return user_data->gbm;
+}
+
+void *get_native_window(int dpy, int win)
+{
+  struct drm_user_data *user_data = (struct drm_user_data *)(long)dpy;
+
+  return user_data->window && win == WINDOW ? user_data->window->surface : NULL;
+}
+
+int get_native_visual(int dpy)
+{
+  return GBM_FORMAT_XRGB8888;
+}
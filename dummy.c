@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "event.h"
 
 static int expose;
@@ -67,18 +68,22 @@ void fini(int display)
 {
 }
 
-int get_event(int display, int *type, int *key, int *x, int *y)
+int get_events(int display, struct event *events, int count)
 {
-  int ret = 0;
+  int n = 0;
 
-  *type = EVENT_NONE;
-  *key = *x = *y = 0;
-
-  if (!expose) {
-    *type = EVENT_DISPLAY;
+  if (!expose && count) {
+    memset(&events[n], 0, sizeof(struct event));
+    events[n].win = 0;
+    events[n].type = EVENT_DISPLAY;
     expose = 1;
-    ret = 1;
+    n++;
   }
 
-  return ret;
+  return n;
+}
+
+int get_event_fd(int display)
+{
+  return -1;
 }
@@ -24,6 +24,7 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <ctype.h>
 #include <dirent.h>
 #include <dlfcn.h>
 #include <limits.h>
@@ -31,7 +32,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include "attributes.h"
+#include "event.h"
 
 #ifdef FIU_ENABLE
 #include <fiu-local.h>
@@ -45,6 +48,8 @@
 #define FIU_CHECK(ptr)
 #endif
 
+#define DEVICES_MAX 16
+
 typedef struct {
   EGLNativeDisplayType native_dpy;
   EGLDisplay egl_dpy;
@@ -54,7 +59,16 @@ typedef struct {
   int (*create_window)(int dpy, int posx, int posy, int width, int height, int opt, int *err);
   void (*destroy_window)(int dpy, int win);
   void (*fini)(int dpy);
-  int (*get_event)(int dpy, int *type, int *key, int *x, int *y);
+  int (*get_events)(int dpy, struct event *events, int count);
+  int (*get_event_fd)(int dpy);
+  int (*get_refresh_rate)(int dpy);
+  void (*swap_window)(int dpy, int win);
+  void *(*get_native_display)(int dpy);
+  void *(*get_native_window)(int dpy, int win);
+  int (*get_native_visual)(int dpy);
+  int (*get_native_platform)(int dpy);
+  int surfaceless;
+  EGLDeviceEXT devices[DEVICES_MAX];
 } glutDisplay;
 
 typedef struct {
@@ -64,9 +78,100 @@ typedef struct {
   struct attributes attribs;
 } glutWindow;
 
+/* device requested by index or name with InitDevice, else with EGL_DEVICE */
+static char egl_device[64];
+
+/* the name is the renderer, else the DRM node, of the device */
+static const char *device_request()
+{
+  return egl_device[0] ? egl_device : getenv("EGL_DEVICE");
+}
+
+static int device_query(EGLDeviceEXT device, char *name, int size)
+{
+  PFNEGLQUERYDEVICESTRINGEXTPROC eglQueryDeviceStringEXT = (PFNEGLQUERYDEVICESTRINGEXTPROC)eglGetProcAddress("eglQueryDeviceStringEXT");
+  const char *extensions = NULL, *str = NULL;
+  int software = 0;
+
+  if (eglQueryDeviceStringEXT) {
+    extensions = eglQueryDeviceStringEXT(device, EGL_EXTENSIONS);
+  }
+  if (extensions) {
+    software = strstr(extensions, "EGL_MESA_device_software") != NULL;
+    if (strstr(extensions, "EGL_EXT_device_query_name")) {
+      str = eglQueryDeviceStringEXT(device, EGL_RENDERER_EXT);
+    }
+    if (!str && strstr(extensions, "EGL_EXT_device_drm_render_node")) {
+      str = eglQueryDeviceStringEXT(device, EGL_DRM_RENDER_NODE_FILE_EXT);
+    }
+    if (!str && strstr(extensions, "EGL_EXT_device_drm")) {
+      str = eglQueryDeviceStringEXT(device, EGL_DRM_DEVICE_FILE_EXT);
+    }
+  }
+
+  snprintf(name, size, "%s", str ? str : software ? "software" : "unknown");
+
+  return software;
+}
+
+static void device_set(glutDisplay *glut_dpy, int index)
+{
+  glut_dpy->attribs.device_index = index;
+  glut_dpy->attribs.device_software = device_query(glut_dpy->devices[index], glut_dpy->attribs.device_name, sizeof(glut_dpy->attribs.device_name));
+}
+
+/* enumerates the devices and returns the requested one, by index or name, else the first hardware one */
+static int device_select(glutDisplay *glut_dpy)
+{
+  PFNEGLQUERYDEVICESEXTPROC eglQueryDevicesEXT = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+  const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  const char *request = device_request();
+  char name[64];
+  int index = -1, index_software = 0, software, i;
+
+  glut_dpy->attribs.device_index = -1;
+
+  if (!extensions || (!strstr(extensions, "EGL_EXT_device_enumeration") && !strstr(extensions, "EGL_EXT_device_base")) || !eglQueryDevicesEXT || !eglQueryDevicesEXT(DEVICES_MAX, glut_dpy->devices, &glut_dpy->attribs.device_count)) {
+    glut_dpy->attribs.device_count = 0;
+  }
+
+  for (i = 0; i < glut_dpy->attribs.device_count; i++) {
+    software = device_query(glut_dpy->devices[i], name, sizeof(name));
+    if (request) {
+      if (isdigit((unsigned char)request[0]) ? atoi(request) == i : strstr(name, request) != NULL) {
+        index = i;
+        break;
+      }
+    }
+    else if (index == -1 || (index_software && !software)) {
+      index = i;
+      index_software = software;
+    }
+  }
+
+  if (request && index == -1) {
+    printf("EGL device %s not found\n", request);
+    return -2;
+  }
+
+  if (index != -1) {
+    device_set(glut_dpy, index);
+  }
+
+  return index;
+}
+
+void InitDevice(const char *device)
+{
+  snprintf(egl_device, sizeof(egl_device), "%s", device ? device : "");
+}
+
 int Init()
 {
-  int err = 0;
+  int err = 0, device = 0, i;
+  EGLAttrib egl_dpy_device = 0;
+  EGLenum egl_platform = 0;
+  PFNEGLQUERYDISPLAYATTRIBEXTPROC eglQueryDisplayAttribEXT;
   char platform_path[PATH_MAX];
   glutDisplay *glut_dpy = NULL;
 
@@ -112,10 +217,21 @@ int Init()
 
   FINDSYM(init);
   FINDSYM(create_window);
-  FINDSYM(get_event);
+  FINDSYM(get_events);
+  FINDSYM(get_event_fd);
   FINDSYM(destroy_window);
   FINDSYM(fini);
 
+  /* optional, for the platforms knowing their refresh rate or compositing on the swapped windows */
+  glut_dpy->get_refresh_rate = dlsym(glut_dpy->platform, "get_refresh_rate");
+  glut_dpy->swap_window = dlsym(glut_dpy->platform, "swap_window");
+
+  /* optional, for the platforms whose native objects are pointers and not handles */
+  glut_dpy->get_native_display = dlsym(glut_dpy->platform, "get_native_display");
+  glut_dpy->get_native_window = dlsym(glut_dpy->platform, "get_native_window");
+  glut_dpy->get_native_visual = dlsym(glut_dpy->platform, "get_native_visual");
+  glut_dpy->get_native_platform = dlsym(glut_dpy->platform, "get_native_platform");
+
   glut_dpy->native_dpy = (EGLNativeDisplayType)(long)glut_dpy->init(&glut_dpy->attribs.dpy_width, &glut_dpy->attribs.dpy_height, &err);
   if (err == -1) {
     goto error;
@@ -124,7 +240,42 @@ int Init()
   glut_dpy->attribs.win_width = glut_dpy->attribs.dpy_width;
   glut_dpy->attribs.win_height = glut_dpy->attribs.dpy_height;
 
-  glut_dpy->egl_dpy = eglGetDisplay(glut_dpy->native_dpy);
+  if (glut_dpy->get_refresh_rate) {
+    glut_dpy->attribs.refresh_rate = glut_dpy->get_refresh_rate((long)glut_dpy->native_dpy);
+  }
+
+  if (glut_dpy->get_native_platform) {
+    egl_platform = glut_dpy->get_native_platform((long)glut_dpy->native_dpy);
+    /* no native windows, the windows are pbuffers */
+    glut_dpy->surfaceless = egl_platform == EGL_PLATFORM_SURFACELESS_MESA;
+  }
+
+  /* EGL devices, the display of the selected one is opened without native windows, the other platforms report theirs */
+  device = device_select(glut_dpy);
+  if (device == -2) {
+    goto error;
+  }
+
+  if (glut_dpy->get_native_platform) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!eglGetPlatformDisplayEXT) {
+      printf("eglGetPlatformDisplayEXT not supported\n");
+      goto error;
+    }
+    if (glut_dpy->surfaceless && device >= 0 && strstr(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS), "EGL_EXT_platform_device")) {
+      glut_dpy->egl_dpy = eglGetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, glut_dpy->devices[device], NULL);
+      egl_dpy_device = (EGLAttrib)glut_dpy->devices[device];
+    }
+    else {
+      glut_dpy->egl_dpy = eglGetPlatformDisplayEXT(egl_platform, glut_dpy->get_native_display ? glut_dpy->get_native_display((long)glut_dpy->native_dpy) : EGL_DEFAULT_DISPLAY, NULL);
+    }
+  }
+  else if (glut_dpy->get_native_display) {
+    glut_dpy->egl_dpy = eglGetDisplay(glut_dpy->get_native_display((long)glut_dpy->native_dpy));
+  }
+  else {
+    glut_dpy->egl_dpy = eglGetDisplay(glut_dpy->native_dpy);
+  }
   if (!glut_dpy->egl_dpy) {
     printf("eglGetDisplay error: 0x%x\n", eglGetError());
     goto error;
@@ -136,6 +287,26 @@ int Init()
     goto error;
   }
 
+  /* the other platforms choose their device, only reported when the display knows it */
+  if (!egl_dpy_device && glut_dpy->attribs.device_count) {
+    eglQueryDisplayAttribEXT = (PFNEGLQUERYDISPLAYATTRIBEXTPROC)eglGetProcAddress("eglQueryDisplayAttribEXT");
+    if (!eglQueryDisplayAttribEXT || !eglQueryDisplayAttribEXT(glut_dpy->egl_dpy, EGL_DEVICE_EXT, &egl_dpy_device)) {
+      egl_dpy_device = 0;
+    }
+    for (i = 0; i < glut_dpy->attribs.device_count && (EGLDeviceEXT)egl_dpy_device != glut_dpy->devices[i]; i++);
+    if (i < glut_dpy->attribs.device_count) {
+      device_set(glut_dpy, i);
+    }
+    else {
+      glut_dpy->attribs.device_index = -1;
+      glut_dpy->attribs.device_software = 0;
+      glut_dpy->attribs.device_name[0] = 0;
+    }
+    if (device_request() && i != device) {
+      printf("EGL device %s not selectable with this platform\n", device_request());
+    }
+  }
+
   return (long)glut_dpy;
 
 error:
@@ -190,9 +361,9 @@ int CreateWindow(int display)
   int err = 0;
   glutDisplay *glut_dpy = (glutDisplay *)(long)display;
   glutWindow *glut_win = NULL;
-  EGLConfig egl_config = NULL;
-  EGLint egl_config_attr[5], egl_win_attr[3], egl_ctx_attr[3];
-  EGLint i = 0, egl_renderable_type = 0, egl_glapi, egl_gles_version;
+  EGLConfig egl_config = NULL, egl_configs[64];
+  EGLint egl_config_attr[7], egl_win_attr[5], egl_ctx_attr[3];
+  EGLint i = 0, j, egl_renderable_type = 0, egl_glapi, egl_gles_version, egl_visual;
 
   glut_win = calloc(1, sizeof(glutWindow));
   FIU_CHECK(glut_win);
@@ -249,31 +420,70 @@ int CreateWindow(int display)
   }
   egl_config_attr[i++] = EGL_RENDERABLE_TYPE;
   egl_config_attr[i++] = egl_renderable_type;
+  if (glut_dpy->surfaceless) {
+    egl_config_attr[i++] = EGL_SURFACE_TYPE;
+    egl_config_attr[i++] = EGL_PBUFFER_BIT;
+  }
   egl_config_attr[i] = EGL_NONE;
-  err = eglChooseConfig(glut_dpy->egl_dpy, egl_config_attr, &egl_config, 1, &i);
-  if (!err) {
+  err = eglChooseConfig(glut_dpy->egl_dpy, egl_config_attr, egl_configs, 64, &i);
+  if (!err || !i) {
     printf("eglChooseConfig error: 0x%x\n", eglGetError());
     goto error;
   }
 
+  /* the platform surfaces may only accept the configs of their pixel format */
+  egl_config = egl_configs[0];
+  if (glut_dpy->get_native_visual) {
+    for (j = 0; j < i; j++) {
+      if (eglGetConfigAttrib(glut_dpy->egl_dpy, egl_configs[j], EGL_NATIVE_VISUAL_ID, &egl_visual) && egl_visual == glut_dpy->get_native_visual((long)glut_dpy->native_dpy)) {
+        egl_config = egl_configs[j];
+        break;
+      }
+    }
+  }
+
   glut_win->native_win = (EGLNativeWindowType)(long)glut_dpy->create_window((long)glut_dpy->native_dpy, glut_win->attribs.win_posx, glut_win->attribs.win_posy, glut_win->attribs.win_width, glut_win->attribs.win_height, 0, &err);
   if (err == -1) {
     goto error;
   }
 
   memset(egl_win_attr, 0, sizeof(egl_win_attr));
-  egl_win_attr[0] = EGL_RENDER_BUFFER;
-  if (glut_win->attribs.double_buffer) {
-    egl_win_attr[1] = EGL_BACK_BUFFER;
+  if (glut_dpy->surfaceless) {
+    /* single buffered, a swap only flushes the rendering */
+    egl_win_attr[0] = EGL_WIDTH;
+    egl_win_attr[1] = glut_win->attribs.win_width;
+    egl_win_attr[2] = EGL_HEIGHT;
+    egl_win_attr[3] = glut_win->attribs.win_height;
+    egl_win_attr[4] = EGL_NONE;
+    glut_win->egl_win = eglCreatePbufferSurface(glut_dpy->egl_dpy, egl_config, egl_win_attr);
+    if (!glut_win->egl_win) {
+      printf("eglCreatePbufferSurface error: 0x%x\n", eglGetError());
+      goto error;
+    }
   }
   else {
-    egl_win_attr[1] = EGL_SINGLE_BUFFER;
-  }
-  egl_win_attr[2] = EGL_NONE;
-  glut_win->egl_win = eglCreateWindowSurface(glut_dpy->egl_dpy, egl_config, glut_win->native_win, egl_win_attr);
-  if (!glut_win->egl_win) {
-    printf("eglCreateWindowSurface error: 0x%x\n", eglGetError());
-    goto error;
+    egl_win_attr[0] = EGL_RENDER_BUFFER;
+    if (glut_win->attribs.double_buffer) {
+      egl_win_attr[1] = EGL_BACK_BUFFER;
+    }
+    else {
+      egl_win_attr[1] = EGL_SINGLE_BUFFER;
+    }
+    egl_win_attr[2] = EGL_NONE;
+    if (glut_dpy->get_native_window) {
+      glut_win->egl_win = eglCreateWindowSurface(glut_dpy->egl_dpy, egl_config, (EGLNativeWindowType)glut_dpy->get_native_window((long)glut_dpy->native_dpy, (long)glut_win->native_win), egl_win_attr);
+    }
+    else {
+      glut_win->egl_win = eglCreateWindowSurface(glut_dpy->egl_dpy, egl_config, glut_win->native_win, egl_win_attr);
+    }
+    if (!glut_win->egl_win) {
+      printf("eglCreateWindowSurface error: 0x%x\n", eglGetError());
+      goto error;
+    }
+    /* the platforms may not honor the requested size, the drm windows are fullscreen */
+    if (!eglQuerySurface(glut_dpy->egl_dpy, glut_win->egl_win, EGL_WIDTH, &glut_win->attribs.win_width) || !eglQuerySurface(glut_dpy->egl_dpy, glut_win->egl_win, EGL_HEIGHT, &glut_win->attribs.win_height)) {
+      printf("eglQuerySurface error: 0x%x\n", eglGetError());
+    }
   }
 
   i = 0;
@@ -336,6 +546,10 @@ void SwapBuffers(int display, int window)
   glutWindow *glut_win = (glutWindow *)(long)window;
 
   eglSwapBuffers(glut_dpy->egl_dpy, glut_win->egl_win);
+
+  if (glut_dpy->swap_window) {
+    glut_dpy->swap_window((long)glut_dpy->native_dpy, (long)glut_win->native_win);
+  }
 }
 
 struct attributes *GetDisplayAttribs(int display)
@@ -379,9 +593,16 @@ void Fini(int display)
   free(glut_dpy);
 }
 
-int GetEvent(int display, int *type, int *key, int *x, int *y)
+int GetEvents(int display, struct event *events, int count)
+{
+  glutDisplay *glut_dpy = (glutDisplay *)(long)display;
+
+  return glut_dpy->get_events((long)glut_dpy->native_dpy, events, count);
+}
+
+int GetEventFd(int display)
 {
   glutDisplay *glut_dpy = (glutDisplay *)(long)display;
 
-  return glut_dpy->get_event((long)glut_dpy->native_dpy, type, key, x, y);
+  return glut_dpy->get_event_fd((long)glut_dpy->native_dpy);
 }
@@ -31,3 +31,12 @@ enum {
   EVENT_SPECIAL,
   EVENT_PASSIVEMOTION
 };
+
+struct event {
+  int win;
+  int type;
+  int key;
+  int x;
+  int y;
+  long long time;
+};
@@ -24,23 +24,63 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <linux/fb.h>
 #include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <sys/mman.h>
+#include "blit.h"
 #include "event.h"
 #include "keys.h"
 
-#define MAX(a,b) a > b ? a : b
+#define TEST_BIT(bit, array) ((array[(bit) / (8 * sizeof(long))] >> ((bit) % (8 * sizeof(long)))) & 1)
+
+/* arrow cursor, hot spot at its tip: 'X' is the outline, '.' the fill */
+#define CURSOR_W 12
+#define CURSOR_H 19
+
+static const char *cursor_image[CURSOR_H] = {
+  "X           ",
+  "XX          ",
+  "X.X         ",
+  "X..X        ",
+  "X...X       ",
+  "X....X      ",
+  "X.....X     ",
+  "X......X    ",
+  "X.......X   ",
+  "X........X  ",
+  "X.........X ",
+  "X......XXXXX",
+  "X...X..X    ",
+  "X..XX..X    ",
+  "X.X  X..X   ",
+  "XX   X..X   ",
+  "X     X..X  ",
+  "      X..X  ",
+  "       XX   ",
+};
+
+/* refresh rate in millihertz when the video mode timings are unknown */
+#define REFRESH_RATE 60000
 
-#define W 4
-#define H 6
+/* events queued by the input thread for get_events, a power of two */
+#define EVENTS_SIZE 256
+
+/* evdev events read at once, and key presses kept in a report frame */
+#define INPUT_EVENTS_MAX 64
+#define FRAME_KEYS_MAX 16
 
 struct fb_list {
   struct fb_list *next;
@@ -52,6 +92,9 @@ struct fb_window {
   int height;
   int posx;
   int posy;
+  int expose;
+  unsigned char *pixels;
+  int stride;
   struct fb_list link;
 };
 
@@ -66,125 +109,676 @@ struct fb_event {
   int keycode;
   int x;
   int y;
+  long long time;
   struct fb_window *window;
+};
+
+/* latest pointer position when the event ring is full, pos is the ring position it would have taken,
+   no event is queued after it while it is pending, it is merged by the input thread and taken by get_events
+   under window_mutex */
+struct fb_motion {
+  atomic_int pending;
+  unsigned int pos;
+  int x;
+  int y;
+  long long time;
+  struct fb_window *window;
+};
+
+struct fb_device {
+  int fd;
+  char path[64];
+  int monotonic;
   struct fb_list link;
+  int dx;
+  int dy;
+  int keys[FRAME_KEYS_MAX];
+  int keys_count;
+  int dropped;
 };
 
+/* the input thread only moves the cursor position, it is composited on the screen by swap_window or get_events
+   from the save-under buffer, in the refresh period when nothing is swapped,
+   vsync is cleared when the driver has no FBIO_WAITFORVSYNC and vblanks are then estimated from vsync_time,
+   in compositor mode the windows render in their own pixels and shadow is a copy of the screen they are composed to,
+   cursor_mutex then serializes all the writes to the screen */
 struct fb_user_data {
   int bpp;
   int w;
   int h;
   unsigned char *screen;
-  int cx;
-  int cy;
-  int cw;
-  int ch;
+  atomic_int cx;
+  atomic_int cy;
+  atomic_int cursor_dirty;
   unsigned char *cursor;
-  int keyboard;
-  int mouse;
+  unsigned char *cursor_mask;
+  unsigned char *cursor_under;
+  unsigned char *cursor_row;
+  int cursor_x;
+  int cursor_y;
+  int cursor_drawn;
+  pthread_mutex_t cursor_mutex;
+  int compositor;
+  unsigned char *shadow;
+  unsigned char *compose_row;
+  int refresh_rate;
+  long long refresh;
+  atomic_int vsync;
+  long long vsync_time;
+  atomic_llong cursor_time;
+  atomic_llong swap_time;
+  struct fb_list device_list;
+  int epoll;
+  int inotify;
   struct fb_list window_list;
-  struct fb_list event_list;
+  pthread_mutex_t window_mutex;
+  atomic_int expose;
+  struct fb_event events[EVENTS_SIZE];
+  atomic_uint head;
+  atomic_uint tail;
+  struct fb_motion motion;
+  int event_fd;
+  atomic_int event_fd_signaled;
   int pipe[2];
   pthread_t thread;
 };
 
-static void *input_thread(void *data)
+/* the display handle stays the framebuffer fd, used as such by glfbdev and the EGL fbdev platforms,
+   the user data of each display is found from it in a table indexed by fd */
+static struct fb_user_data **user_data_table = NULL;
+static int user_data_table_size = 0;
+
+/* single producer (the input thread), single consumer (get_events on the main thread) */
+static int event_push(struct fb_user_data *user_data, struct fb_event *event)
+{
+  unsigned int head = atomic_load_explicit(&user_data->head, memory_order_relaxed);
+
+  if (head - atomic_load_explicit(&user_data->tail, memory_order_acquire) == EVENTS_SIZE) {
+    return -1;
+  }
+
+  user_data->events[head & (EVENTS_SIZE - 1)] = *event;
+  atomic_store_explicit(&user_data->head, head + 1, memory_order_release);
+
+  return 0;
+}
+
+/* called with window_mutex held */
+static void motion_store(struct fb_user_data *user_data, struct fb_event *event)
+{
+  struct fb_motion *motion = &user_data->motion;
+
+  /* merged motion keeps the ring position and the time of its first sample */
+  if (!atomic_load_explicit(&motion->pending, memory_order_relaxed)) {
+    motion->pos = atomic_load_explicit(&user_data->head, memory_order_relaxed);
+    motion->time = event->time;
+  }
+  motion->x = event->x;
+  motion->y = event->y;
+  motion->window = event->window;
+
+  atomic_store_explicit(&motion->pending, 1, memory_order_release);
+}
+
+/* the merged motion is no longer pending once taken, called with window_mutex held */
+static void motion_take(struct fb_motion *motion, struct fb_event *event)
+{
+  memset(event, 0, sizeof(struct fb_event));
+  event->type = FB_EVENT_MOUSE;
+  event->x = motion->x;
+  event->y = motion->y;
+  event->time = motion->time;
+  event->window = motion->window;
+
+  atomic_store_explicit(&motion->pending, 0, memory_order_relaxed);
+}
+
+/* move the merged motion back into the ring before newer events, to keep them ordered, called with window_mutex held */
+static void motion_requeue(struct fb_user_data *user_data)
+{
+  struct fb_event event;
+
+  if (!atomic_load_explicit(&user_data->motion.pending, memory_order_relaxed)) {
+    return;
+  }
+
+  if (atomic_load_explicit(&user_data->head, memory_order_relaxed) - atomic_load_explicit(&user_data->tail, memory_order_acquire) == EVENTS_SIZE) {
+    return;
+  }
+
+  motion_take(&user_data->motion, &event);
+  event_push(user_data, &event);
+}
+
+/* the eventfd is only written when get_events has cleared it, and only read then */
+static void event_signal(struct fb_user_data *user_data)
+{
+  if (!atomic_exchange(&user_data->event_fd_signaled, 1)) {
+    eventfd_write(user_data->event_fd, 1);
+  }
+}
+
+static struct fb_user_data *user_data_get(int fb)
+{
+  return fb >= 0 && fb < user_data_table_size ? user_data_table[fb] : NULL;
+}
+
+static void user_data_clear(int fb)
 {
-  struct fb_user_data *user_data = data;
-  fd_set set;
-  struct input_event input;
   int i = 0;
-  unsigned char *ptr = NULL;
+
+  user_data_table[fb] = NULL;
+
+  for (i = 0; i < user_data_table_size; i++) {
+    if (user_data_table[i]) {
+      return;
+    }
+  }
+
+  free(user_data_table);
+  user_data_table = NULL;
+  user_data_table_size = 0;
+}
+
+static long long fb_time()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* channel bits of the cursor colors in the framebuffer pixel format */
+static unsigned int cursor_pixel(struct fb_var_screeninfo *info, int white)
+{
+  unsigned int pixel = 0;
+
+  if (!white) {
+    return 0;
+  }
+
+  if (info->bits_per_pixel <= 8 || !info->red.length) {
+    return ~0U;
+  }
+
+  pixel |= ((1U << info->red.length) - 1) << info->red.offset;
+  pixel |= ((1U << info->green.length) - 1) << info->green.offset;
+  pixel |= ((1U << info->blue.length) - 1) << info->blue.offset;
+  if (info->transp.length) {
+    pixel |= ((1U << info->transp.length) - 1) << info->transp.offset;
+  }
+
+  return pixel;
+}
+
+/* the formats with conversion kernels, -1 for the others */
+static int fb_format(struct fb_var_screeninfo *info)
+{
+  if (info->bits_per_pixel == 16 && info->red.offset == 11 && info->red.length == 5 && info->green.offset == 5 && info->green.length == 6 && !info->blue.offset && info->blue.length == 5) {
+    return BLIT_RGB565;
+  }
+  if (info->bits_per_pixel == 24 && !info->red.offset && info->green.offset == 8 && info->blue.offset == 16) {
+    return BLIT_RGB888;
+  }
+  if (info->bits_per_pixel == 24 && info->red.offset == 16 && info->green.offset == 8 && !info->blue.offset) {
+    return BLIT_BGR888;
+  }
+  if (info->bits_per_pixel == 32 && info->red.offset == 16 && info->green.offset == 8 && !info->blue.offset) {
+    return BLIT_XRGB8888;
+  }
+
+  return -1;
+}
+
+static void cursor_move(struct fb_user_data *user_data, int dx, int dy)
+{
+  int cx = atomic_load_explicit(&user_data->cx, memory_order_relaxed) + dx;
+  int cy = atomic_load_explicit(&user_data->cy, memory_order_relaxed) + dy;
+
+  cx = cx < 0 ? 0 : cx > user_data->w - 1 ? user_data->w - 1 : cx;
+  cy = cy < 0 ? 0 : cy > user_data->h - 1 ? user_data->h - 1 : cy;
+
+  atomic_store_explicit(&user_data->cx, cx, memory_order_relaxed);
+  atomic_store_explicit(&user_data->cy, cy, memory_order_relaxed);
+  atomic_store_explicit(&user_data->cursor_dirty, 1, memory_order_release);
+}
+
+/* put back the pixels saved under the cursor in the columns [x0, x1) of a row */
+static void cursor_restore(struct fb_user_data *user_data, int row, int x0, int x1)
+{
+  if (x0 < x1) {
+    memcpy(user_data->screen + ((user_data->cursor_y + row) * user_data->w + x0) * user_data->bpp, user_data->cursor_under + (row * CURSOR_W + x0 - user_data->cursor_x) * user_data->bpp, (x1 - x0) * user_data->bpp);
+  }
+}
+
+/* compose the rectangle [x0, x1) x [y0, y1) from the windows in z-order, then the cursor, over a black background:
+   each row is built in cached memory and only the span differing from the shadow is written to the framebuffer */
+static void screen_compose(struct fb_user_data *user_data, int x0, int y0, int x1, int y1)
+{
   struct fb_window *window = NULL;
   struct fb_list *window_link = NULL;
-  struct fb_event *event = NULL;
-  struct fb_list *event_link = NULL;
+  unsigned char *row = user_data->compose_row, *shadow = NULL;
+  int i = 0, j = 0, a = 0, b = 0, bpp = user_data->bpp;
+
+  x0 = x0 < 0 ? 0 : x0;
+  y0 = y0 < 0 ? 0 : y0;
+  x1 = x1 > user_data->w ? user_data->w : x1;
+  y1 = y1 > user_data->h ? user_data->h : y1;
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
 
-  while (1) {
-    FD_ZERO(&set);
-    FD_SET(user_data->pipe[0], &set);
-    FD_SET(user_data->keyboard, &set);
-    FD_SET(user_data->mouse, &set);
+  pthread_mutex_lock(&user_data->window_mutex);
 
-    if (select(MAX(MAX(user_data->keyboard, user_data->mouse), user_data->pipe[0]) + 1, &set, NULL, NULL, NULL) >= 0) {
-      memset(&input, 0, sizeof(struct input_event));
+  for (i = y0; i < y1; i++) {
+    blit_fill(row + x0 * bpp, 0, 0, bpp, x1 - x0, 1);
 
-      if (FD_ISSET(user_data->keyboard, &set)) {
-        read(user_data->keyboard, &input, sizeof(struct input_event));
+    /* the window list starts with the topmost window, it is walked from the bottom */
+    for (window_link = user_data->window_list.prev; window_link != &user_data->window_list; window_link = window_link->prev) {
+      window = (struct fb_window *)((char *)window_link - (char *)&((struct fb_window *)NULL)->link);
+      if (!window->pixels || i < window->posy || i >= window->posy + window->height) {
+        continue;
       }
-      else if (FD_ISSET(user_data->mouse, &set)) {
-        read(user_data->mouse, &input, sizeof(struct input_event));
-      }
-      else if (FD_ISSET(user_data->pipe[0], &set)) {
-        break;
+      a = window->posx > x0 ? window->posx : x0;
+      b = window->posx + window->width < x1 ? window->posx + window->width : x1;
+      if (a < b) {
+        blit_copy(row + a * bpp, 0, window->pixels + (i - window->posy) * window->stride + (a - window->posx) * bpp, 0, (b - a) * bpp, 1);
       }
+    }
 
-      if (input.type == EV_REL) {
-        ptr = user_data->screen + (user_data->cy - H) * user_data->w * user_data->bpp + (user_data->cx - W) * user_data->bpp;
-        for (i = 0; i < user_data->ch; i++) {
-          memcpy(ptr, user_data->cursor + i * user_data->cw * user_data->bpp, user_data->cw * user_data->bpp);
-          ptr += user_data->w * user_data->bpp;
+    if (user_data->cursor_drawn && i >= user_data->cursor_y && i < user_data->cursor_y + CURSOR_H) {
+      a = user_data->cursor_x > x0 ? user_data->cursor_x : x0;
+      b = user_data->cursor_x + CURSOR_W < x1 ? user_data->cursor_x + CURSOR_W : x1;
+      for (j = a; j < b; j++) {
+        if (user_data->cursor_mask[(i - user_data->cursor_y) * CURSOR_W + j - user_data->cursor_x]) {
+          memcpy(row + j * bpp, user_data->cursor + ((i - user_data->cursor_y) * CURSOR_W + j - user_data->cursor_x) * bpp, bpp);
         }
+      }
+    }
 
-        if (input.code == REL_X) {
-          user_data->cx += input.value;
-          user_data->cx = user_data->cx < W ? W : user_data->cx;
-          user_data->cx = user_data->cx > user_data->w - W - 1 ? user_data->w - W - 1 : user_data->cx;
-        }
+    shadow = user_data->shadow + i * user_data->w * bpp;
+    a = x0 * bpp;
+    b = x1 * bpp;
+    while (a < b && row[a] == shadow[a]) {
+      a++;
+    }
+    while (b > a && row[b - 1] == shadow[b - 1]) {
+      b--;
+    }
+    if (a < b) {
+      blit_copy(shadow + a, 0, row + a, 0, b - a, 1);
+      blit_copy(user_data->screen + i * user_data->w * bpp + a, 0, row + a, 0, b - a, 1);
+    }
+  }
 
-        if (input.code == REL_Y) {
-          user_data->cy += input.value;
-          user_data->cy = user_data->cy < H ? H : user_data->cy;
-          user_data->cy = user_data->cy > user_data->h - H - 1 ? user_data->h - H - 1 : user_data->cy;
-        }
+  pthread_mutex_unlock(&user_data->window_mutex);
+}
 
-        ptr = user_data->screen + (user_data->cy - H) * user_data->w * user_data->bpp + (user_data->cx - W) * user_data->bpp;
-        for (i = 0; i < user_data->ch; i++) {
-          memcpy(user_data->cursor + i * user_data->cw * user_data->bpp, ptr, user_data->cw * user_data->bpp);
-          ptr += user_data->w * user_data->bpp;
-        }
+/* the swapped window has just been redrawn, the saved pixels inside it are stale and not restored there */
+static void cursor_composite(struct fb_user_data *user_data, struct fb_window *window)
+{
+  int i = 0, j = 0, x = 0, y = 0, cw = 0, ch = 0, bpp = user_data->bpp;
+  unsigned char *ptr = NULL;
 
-        ptr = user_data->screen + (user_data->cy - H) * user_data->w * user_data->bpp + (user_data->cx - W) * user_data->bpp;
-        for (i = 0; i < user_data->ch; i++) {
-          memset(ptr, 255, user_data->cw * user_data->bpp);
-          ptr += user_data->w * user_data->bpp;
-        }
+  pthread_mutex_lock(&user_data->cursor_mutex);
+
+  /* the cursor is the top layer of the composed screen, its old and new rectangles are damaged */
+  if (user_data->shadow) {
+    atomic_store_explicit(&user_data->cursor_dirty, 0, memory_order_relaxed);
+    x = user_data->cursor_x;
+    y = user_data->cursor_y;
+    user_data->cursor_x = atomic_load_explicit(&user_data->cx, memory_order_relaxed);
+    user_data->cursor_y = atomic_load_explicit(&user_data->cy, memory_order_relaxed);
+    user_data->cursor_drawn = 1;
+    screen_compose(user_data, x, y, x + CURSOR_W, y + CURSOR_H);
+    screen_compose(user_data, user_data->cursor_x, user_data->cursor_y, user_data->cursor_x + CURSOR_W, user_data->cursor_y + CURSOR_H);
+    atomic_store_explicit(&user_data->cursor_time, fb_time(), memory_order_relaxed);
+    pthread_mutex_unlock(&user_data->cursor_mutex);
+    return;
+  }
+
+  /* a still cursor is only drawn again when the swapped window has covered it */
+  if (window && user_data->cursor_drawn && !atomic_load_explicit(&user_data->cursor_dirty, memory_order_relaxed)) {
+    if (user_data->cursor_x >= window->posx + window->width || user_data->cursor_x + CURSOR_W <= window->posx || user_data->cursor_y >= window->posy + window->height || user_data->cursor_y + CURSOR_H <= window->posy) {
+      pthread_mutex_unlock(&user_data->cursor_mutex);
+      return;
+    }
+  }
+
+  atomic_store_explicit(&user_data->cursor_dirty, 0, memory_order_relaxed);
+
+  if (user_data->cursor_drawn) {
+    cw = user_data->w - user_data->cursor_x < CURSOR_W ? user_data->w - user_data->cursor_x : CURSOR_W;
+    ch = user_data->h - user_data->cursor_y < CURSOR_H ? user_data->h - user_data->cursor_y : CURSOR_H;
+    for (i = 0; i < ch; i++) {
+      y = user_data->cursor_y + i;
+      if (window && y >= window->posy && y < window->posy + window->height) {
+        x = window->posx > user_data->cursor_x + cw ? user_data->cursor_x + cw : window->posx;
+        cursor_restore(user_data, i, user_data->cursor_x, x);
+        x = window->posx + window->width < user_data->cursor_x ? user_data->cursor_x : window->posx + window->width;
+        cursor_restore(user_data, i, x, user_data->cursor_x + cw);
+      }
+      else {
+        cursor_restore(user_data, i, user_data->cursor_x, user_data->cursor_x + cw);
       }
+    }
+  }
 
-      if ((input.type == EV_KEY && input.value) || input.type == EV_REL) {
-        for (window_link = user_data->window_list.next; window_link != &user_data->window_list; window_link = window_link->next) {
-          window = (struct fb_window *)((char *)window_link - (char *)&((struct fb_window *)NULL)->link);
-
-          if (user_data->cx >= window->posx && user_data->cx < window->posx + window->width - 1 && user_data->cy >= window->posy && user_data->cy < window->posy + window->height - 1) {
-            event = calloc(1, sizeof(struct fb_event));
-            if (!event) {
-              printf("event calloc failed\n");
-            }
-
-            if (input.type == EV_KEY) {
-              event->type = FB_EVENT_KEYBOARD;
-              event->keycode = input.code;
-            }
-
-            if (input.type == EV_REL) {
-              event->type = FB_EVENT_MOUSE;
-              event->x = user_data->cx - window->posx;
-              event->y = user_data->cy - window->posy;
-            }
-
-            event->window = window;
-            event_link = &event->link;
-            event_link->next = user_data->event_list.next;
-            event_link->prev = &user_data->event_list;
-            user_data->event_list.next->prev = event_link;
-            user_data->event_list.next = event_link;
-            break;
-          }
+  user_data->cursor_x = atomic_load_explicit(&user_data->cx, memory_order_relaxed);
+  user_data->cursor_y = atomic_load_explicit(&user_data->cy, memory_order_relaxed);
+  cw = user_data->w - user_data->cursor_x < CURSOR_W ? user_data->w - user_data->cursor_x : CURSOR_W;
+  ch = user_data->h - user_data->cursor_y < CURSOR_H ? user_data->h - user_data->cursor_y : CURSOR_H;
+
+  /* each row is read once from the framebuffer, blended in cached memory and written back at once */
+  for (i = 0; i < ch; i++) {
+    ptr = user_data->screen + ((user_data->cursor_y + i) * user_data->w + user_data->cursor_x) * bpp;
+    memcpy(user_data->cursor_under + i * CURSOR_W * bpp, ptr, cw * bpp);
+    memcpy(user_data->cursor_row, ptr, cw * bpp);
+    for (j = 0; j < cw; j++) {
+      if (user_data->cursor_mask[i * CURSOR_W + j]) {
+        memcpy(user_data->cursor_row + j * bpp, user_data->cursor + (i * CURSOR_W + j) * bpp, bpp);
+      }
+    }
+    memcpy(ptr, user_data->cursor_row, cw * bpp);
+  }
+
+  user_data->cursor_drawn = 1;
+
+  atomic_store_explicit(&user_data->cursor_time, fb_time(), memory_order_relaxed);
+
+  pthread_mutex_unlock(&user_data->cursor_mutex);
+}
+
+/* queue an event for the window under the cursor */
+static void window_event(struct fb_user_data *user_data, int type, int keycode, long long time)
+{
+  struct fb_window *window = NULL;
+  struct fb_list *window_link = NULL;
+  struct fb_event event;
+  int cx = atomic_load_explicit(&user_data->cx, memory_order_relaxed);
+  int cy = atomic_load_explicit(&user_data->cy, memory_order_relaxed);
+
+  pthread_mutex_lock(&user_data->window_mutex);
+
+  for (window_link = user_data->window_list.next; window_link != &user_data->window_list; window_link = window_link->next) {
+    window = (struct fb_window *)((char *)window_link - (char *)&((struct fb_window *)NULL)->link);
+
+    if (cx >= window->posx && cx < window->posx + window->width - 1 && cy >= window->posy && cy < window->posy + window->height - 1) {
+      memset(&event, 0, sizeof(struct fb_event));
+      event.type = type;
+      event.keycode = keycode;
+      event.x = cx - window->posx;
+      event.y = cy - window->posy;
+      event.time = time;
+      event.window = window;
+
+      motion_requeue(user_data);
+
+      /* still pending when the ring is full, the newer events are then merged into it or dropped */
+      if (atomic_load_explicit(&user_data->motion.pending, memory_order_relaxed) || event_push(user_data, &event)) {
+        if (event.type == FB_EVENT_MOUSE) {
+          motion_store(user_data, &event);
+        }
+        else {
+          printf("event queue full, key %d dropped\n", event.keycode);
         }
       }
+
+      event_signal(user_data);
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&user_data->window_mutex);
+}
+
+/* a report frame is complete: one cursor update and one motion event for all its relative axes */
+static void input_frame(struct fb_user_data *user_data, struct fb_device *device, long long time)
+{
+  int i = 0;
+
+  if (device->dx || device->dy) {
+    cursor_move(user_data, device->dx, device->dy);
+    window_event(user_data, FB_EVENT_MOUSE, 0, time);
+  }
+
+  for (i = 0; i < device->keys_count; i++) {
+    window_event(user_data, FB_EVENT_KEYBOARD, device->keys[i], time);
+  }
+
+  device->dx = device->dy = 0;
+  device->keys_count = 0;
+}
+
+/* returns -1 when the device is gone */
+static int input_read(struct fb_user_data *user_data, struct fb_device *device)
+{
+  struct input_event input[INPUT_EVENTS_MAX];
+  ssize_t size = 0;
+  int i = 0, count = 0;
+
+  size = read(device->fd, input, sizeof(input));
+  if (size == -1 && errno == ENODEV) {
+    return -1;
+  }
+  if (size < (ssize_t)sizeof(struct input_event)) {
+    return 0;
+  }
+
+  count = size / sizeof(struct input_event);
+
+  for (i = 0; i < count; i++) {
+    if (input[i].type == EV_SYN && input[i].code == SYN_DROPPED) {
+      /* the kernel queue overflowed, drop everything up to the next report */
+      device->dropped = 1;
+      device->dx = device->dy = 0;
+      device->keys_count = 0;
+      continue;
+    }
+
+    if (device->dropped) {
+      if (input[i].type == EV_SYN && input[i].code == SYN_REPORT) {
+        device->dropped = 0;
+      }
+      continue;
+    }
+
+    if (input[i].type == EV_REL && input[i].code == REL_X) {
+      device->dx += input[i].value;
+    }
+    else if (input[i].type == EV_REL && input[i].code == REL_Y) {
+      device->dy += input[i].value;
+    }
+    else if (input[i].type == EV_KEY && input[i].value && device->keys_count < FRAME_KEYS_MAX) {
+      device->keys[device->keys_count++] = input[i].code;
+    }
+    else if (input[i].type == EV_SYN && input[i].code == SYN_REPORT) {
+      input_frame(user_data, device, device->monotonic ? input[i].input_event_sec * 1000000000LL + input[i].input_event_usec * 1000LL : 0);
+    }
+  }
+
+  return 0;
+}
+
+static struct fb_device *device_get(struct fb_user_data *user_data, int fd, const char *path)
+{
+  struct fb_device *device = NULL;
+  struct fb_list *device_link = NULL;
+
+  for (device_link = user_data->device_list.next; device_link != &user_data->device_list; device_link = device_link->next) {
+    device = (struct fb_device *)((char *)device_link - (char *)&((struct fb_device *)NULL)->link);
+    if ((path && !strcmp(device->path, path)) || (!path && device->fd == fd)) {
+      return device;
+    }
+  }
+
+  return NULL;
+}
+
+/* keyboards and pointers are kept, other devices are closed unless check is 0 */
+static struct fb_device *device_open(struct fb_user_data *user_data, const char *path, int check)
+{
+  struct fb_device *device = NULL;
+  struct fb_list *device_link = NULL;
+  struct epoll_event event;
+  unsigned long ev_bits[1], key_bits[KEY_CNT / (8 * sizeof(long)) + 1], rel_bits[REL_CNT / (8 * sizeof(long)) + 1];
+  int fd = -1, clock = CLOCK_MONOTONIC;
+
+  device = device_get(user_data, -1, path);
+  if (device) {
+    return device;
+  }
+
+  fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  if (check) {
+    memset(ev_bits, 0, sizeof(ev_bits));
+    memset(key_bits, 0, sizeof(key_bits));
+    memset(rel_bits, 0, sizeof(rel_bits));
+    ioctl(fd, EVIOCGBIT(0, sizeof(ev_bits)), ev_bits);
+    if (TEST_BIT(EV_KEY, ev_bits)) {
+      ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits);
+    }
+    if (TEST_BIT(EV_REL, ev_bits)) {
+      ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rel_bits)), rel_bits);
+    }
+    if (!(TEST_BIT(EV_KEY, ev_bits) && TEST_BIT(KEY_A, key_bits)) && !(TEST_BIT(EV_REL, ev_bits) && TEST_BIT(REL_X, rel_bits) && TEST_BIT(REL_Y, rel_bits))) {
+      close(fd);
+      return NULL;
+    }
+  }
+
+  device = calloc(1, sizeof(struct fb_device));
+  if (!device) {
+    printf("fb_device calloc failed\n");
+    close(fd);
+    return NULL;
+  }
+
+  device->fd = fd;
+  snprintf(device->path, sizeof(device->path), "%s", path);
+
+  /* input events are timestamped on the clock used by glut for the input latency */
+  device->monotonic = !ioctl(fd, EVIOCSCLOCKID, &clock);
+
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  epoll_ctl(user_data->epoll, EPOLL_CTL_ADD, fd, &event);
+
+  device_link = &device->link;
+  device_link->next = user_data->device_list.next;
+  device_link->prev = &user_data->device_list;
+  user_data->device_list.next->prev = device_link;
+  user_data->device_list.next = device_link;
+
+  return device;
+}
+
+static void device_close(struct fb_user_data *user_data, struct fb_device *device)
+{
+  epoll_ctl(user_data->epoll, EPOLL_CTL_DEL, device->fd, NULL);
+  close(device->fd);
+  device->link.next->prev = device->link.prev;
+  device->link.prev->next = device->link.next;
+  free(device);
+}
+
+/* input devices added or removed in /dev/input */
+static void hotplug_read(struct fb_user_data *user_data)
+{
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct inotify_event *event = NULL;
+  struct fb_device *device = NULL;
+  char path[64];
+  ssize_t size = 0, i = 0;
+
+  size = read(user_data->inotify, buffer, sizeof(buffer));
+
+  for (i = 0; i < size; i += sizeof(struct inotify_event) + event->len) {
+    event = (struct inotify_event *)(buffer + i);
+    if (!event->len || strncmp(event->name, "event", 5)) {
+      continue;
+    }
+
+    snprintf(path, sizeof(path), "/dev/input/%.52s", event->name);
+
+    if (event->mask & IN_DELETE) {
+      device = device_get(user_data, -1, path);
+      if (device) {
+        device_close(user_data, device);
+      }
     }
     else {
-      printf("select failed: %s\n", strerror(errno));
+      /* the node may not be readable yet when it is created, it is opened again when its attributes change */
+      device_open(user_data, path, 1);
+    }
+  }
+}
+
+static void devices_close(struct fb_user_data *user_data)
+{
+  while (user_data->device_list.next != &user_data->device_list) {
+    device_close(user_data, (struct fb_device *)((char *)user_data->device_list.next - (char *)&((struct fb_device *)NULL)->link));
+  }
+
+  if (user_data->inotify != -1) {
+    close(user_data->inotify);
+  }
+
+  if (user_data->epoll != -1) {
+    close(user_data->epoll);
+  }
+}
+
+static void *input_thread(void *data)
+{
+  struct fb_user_data *user_data = data;
+  struct epoll_event events[16];
+  struct fb_device *device = NULL;
+  long long wait = 0;
+  int i = 0, count = 0, timeout = -1;
+
+  while (1) {
+    /* a moved cursor not yet composited by a swap wakes get_events up once per refresh period */
+    timeout = -1;
+    if (atomic_load_explicit(&user_data->cursor_dirty, memory_order_acquire)) {
+      wait = atomic_load_explicit(&user_data->cursor_time, memory_order_relaxed);
+      wait = atomic_load_explicit(&user_data->swap_time, memory_order_relaxed) > wait ? atomic_load_explicit(&user_data->swap_time, memory_order_relaxed) : wait;
+      wait += user_data->refresh - fb_time();
+      if (wait <= 0) {
+        event_signal(user_data);
+        wait = user_data->refresh;
+      }
+      timeout = (wait + 999999) / 1000000;
+    }
+
+    count = epoll_wait(user_data->epoll, events, sizeof(events) / sizeof(events[0]), timeout);
+    if (count == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("epoll_wait failed: %s\n", strerror(errno));
+      break;
+    }
+
+    for (i = 0; i < count; i++) {
+      if (events[i].data.fd == user_data->pipe[0]) {
+        return NULL;
+      }
+      else if (events[i].data.fd == user_data->inotify) {
+        hotplug_read(user_data);
+      }
+      else {
+        device = device_get(user_data, events[i].data.fd, NULL);
+        if (device && input_read(user_data, device) == -1) {
+          device_close(user_data, device);
+        }
+      }
     }
   }
 
@@ -195,11 +789,16 @@ int init(int *width, int *height, int *err)
 {
   int ret = 0;
   int fb = -1;
-  struct fb_user_data *user_data = NULL;
+  struct fb_user_data *user_data = NULL, **table = NULL;
   struct fb_var_screeninfo info;
+  struct epoll_event event;
+  DIR *dir = NULL;
+  struct dirent *entry = NULL;
   int i = 0;
-  char name[32], path[32];
-  unsigned char *ptr = NULL;
+  char path[64];
+  unsigned int pixel = 0;
+  unsigned char rgba[CURSOR_W * CURSOR_H * 4];
+  int format = 0;
 
   if (getenv("FRAMEBUFFER")) {
     fb = open(getenv("FRAMEBUFFER"), O_RDWR);
@@ -222,8 +821,12 @@ int init(int *width, int *height, int *err)
     goto fail;
   }
   else {
-    user_data->keyboard = -1;
-    user_data->mouse = -1;
+    user_data->pipe[0] = -1;
+    user_data->pipe[1] = -1;
+    user_data->epoll = -1;
+    user_data->inotify = -1;
+    user_data->event_fd = -1;
+    pthread_mutex_init(&user_data->cursor_mutex, NULL);
   }
 
   memset(&info, 0, sizeof(struct fb_var_screeninfo));
@@ -233,107 +836,82 @@ int init(int *width, int *height, int *err)
     goto fail;
   }
 
-  info.reserved[0] = (long)user_data;
-  ret = ioctl(fb, FBIOPUT_VSCREENINFO, &info);
-  if (ret == -1) {
-    printf("ioctl FBIOPUT_VSCREENINFO failed: %s\n", strerror(errno));
-    goto fail;
-  }
-  ioctl(fb, FBIOGET_VSCREENINFO, &info);
-  if (!info.reserved[0]) {
-    printf("ioctl FBIOGET_VSCREENINFO reserved failed\n");
-    goto fail;
+  if (fb >= user_data_table_size) {
+    table = realloc(user_data_table, (fb + 1) * sizeof(struct fb_user_data *));
+    if (!table) {
+      printf("user_data table realloc failed\n");
+      goto fail;
+    }
+    memset(table + user_data_table_size, 0, (fb + 1 - user_data_table_size) * sizeof(struct fb_user_data *));
+    user_data_table = table;
+    user_data_table_size = fb + 1;
   }
 
+  user_data_table[fb] = user_data;
+
   user_data->bpp = info.bits_per_pixel >> 3;
 
   user_data->w = info.xres;
   user_data->h = info.yres;
-  user_data->screen = mmap(NULL, user_data->w * user_data->h * user_data->bpp, PROT_WRITE, MAP_SHARED, fb, 0);
-
-  user_data->cx = info.xres >> 1;
-  user_data->cy = info.yres >> 1;
-
-  user_data->cw = 2 * W + 1;
-  user_data->ch = 2 * H + 1;
-  user_data->cursor = calloc(user_data->cw * user_data->ch, user_data->bpp);
-  if (!user_data->cursor) {
-    printf("cursor calloc failed\n");
+  user_data->screen = mmap(NULL, user_data->w * user_data->h * user_data->bpp, PROT_READ | PROT_WRITE, MAP_SHARED, fb, 0);
+  if (user_data->screen == MAP_FAILED) {
+    printf("mmap failed: %s\n", strerror(errno));
+    user_data->screen = NULL;
     goto fail;
   }
 
-  ptr = user_data->screen + (user_data->cy - H) * user_data->w * user_data->bpp + (user_data->cx - W) * user_data->bpp;
-  for (i = 0; i < user_data->ch; i++) {
-    memcpy(user_data->cursor + i * user_data->cw * user_data->bpp, ptr, user_data->cw * user_data->bpp);
-    memset(ptr, 255, user_data->cw * user_data->bpp);
-    ptr += user_data->w * user_data->bpp;
+  user_data->cursor = calloc(CURSOR_W * CURSOR_H, user_data->bpp);
+  user_data->cursor_mask = calloc(CURSOR_W * CURSOR_H, 1);
+  user_data->cursor_under = calloc(CURSOR_W * CURSOR_H, user_data->bpp);
+  user_data->cursor_row = calloc(CURSOR_W, user_data->bpp);
+  if (!user_data->cursor || !user_data->cursor_mask || !user_data->cursor_under || !user_data->cursor_row) {
+    printf("cursor calloc failed\n");
+    goto fail;
   }
 
-  if (getenv("KEYBOARD")) {
-    user_data->keyboard = open(getenv("KEYBOARD"), O_RDONLY);
-    if (user_data->keyboard == -1) {
-      printf("open %s failed: %s\n", getenv("KEYBOARD"), strerror(errno));
-      goto fail;
+  /* the cursor image is converted once to the framebuffer pixel format */
+  format = fb_format(&info);
+  for (i = 0; i < CURSOR_W * CURSOR_H; i++) {
+    memset(rgba + i * 4, cursor_image[i / CURSOR_W][i % CURSOR_W] == '.' ? 0xFF : 0, 3);
+    rgba[i * 4 + 3] = 0xFF;
+    if (format == -1) {
+      pixel = cursor_pixel(&info, cursor_image[i / CURSOR_W][i % CURSOR_W] == '.');
+      memcpy(user_data->cursor + i * user_data->bpp, &pixel, user_data->bpp);
     }
+    user_data->cursor_mask[i] = cursor_image[i / CURSOR_W][i % CURSOR_W] != ' ';
   }
-  else {
-    i = 0;
-    while (1) {
-      sprintf(path, "/dev/input/event%d", i);
-      user_data->keyboard = open(path, O_RDONLY);
-      if (user_data->keyboard == -1) {
-        sprintf(path, "/dev/input/event0");
-        break;
-      }
-      ioctl(user_data->keyboard, EVIOCGNAME(sizeof(name)), name);
-      close(user_data->keyboard);
-      if (!strcmp(name, "uinput-keyboard")) {
-        break;
-      }
-      i++;
-    }
-    user_data->keyboard = open(path, O_RDONLY);
-    if (user_data->keyboard == -1) {
-      printf("open %s failed: %s\n", path, strerror(errno));
-      goto fail;
-    }
+  if (format != -1) {
+    blit_convert(format, user_data->cursor, rgba, CURSOR_W * CURSOR_H);
   }
 
-  if (getenv("MOUSE")) {
-    user_data->mouse = open(getenv("MOUSE"), O_RDONLY);
-    if (user_data->mouse == -1) {
-      printf("open %s failed: %s\n", getenv("MOUSE"), strerror(errno));
-      goto fail;
-    }
+  /* refresh rate of the video mode from its pixel clock (in picoseconds) and its timings */
+  if (info.pixclock) {
+    user_data->refresh_rate = 1000000000000000LL / ((long long)info.pixclock * (info.left_margin + info.xres + info.right_margin + info.hsync_len) * (info.upper_margin + info.yres + info.lower_margin + info.vsync_len));
   }
-  else {
-    i = 0;
-    while (1) {
-      sprintf(path, "/dev/input/event%d", i);
-      user_data->mouse = open(path, O_RDONLY);
-      if (user_data->mouse == -1) {
-        sprintf(path, "/dev/input/event1");
-        break;
-      }
-      ioctl(user_data->mouse, EVIOCGNAME(sizeof(name)), name);
-      close(user_data->mouse);
-      if (!strcmp(name, "uinput-mouse")) {
-        break;
-      }
-      i++;
-    }
-    user_data->mouse = open(path, O_RDONLY);
-    if (user_data->mouse == -1) {
-      printf("open %s failed: %s\n", path, strerror(errno));
-      goto fail;
-    }
+  if (user_data->refresh_rate <= 0) {
+    user_data->refresh_rate = REFRESH_RATE;
+  }
+  user_data->refresh = 1000000000000LL / user_data->refresh_rate;
+
+  /* COMPOSITOR composes the windows rendered offscreen by the backends supporting it */
+  if (getenv("COMPOSITOR") && atoi(getenv("COMPOSITOR"))) {
+    user_data->compositor = 1;
   }
+  user_data->vsync = 1;
+  user_data->vsync_time = fb_time();
+  user_data->cx = info.xres >> 1;
+  user_data->cy = info.yres >> 1;
+  user_data->cursor_dirty = 1;
 
   user_data->window_list.next = &user_data->window_list;
   user_data->window_list.prev = &user_data->window_list;
+  pthread_mutex_init(&user_data->window_mutex, NULL);
 
-  user_data->event_list.next = &user_data->event_list;
-  user_data->event_list.prev = &user_data->event_list;
+  user_data->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (user_data->event_fd == -1) {
+    printf("eventfd failed: %s\n", strerror(errno));
+    goto fail;
+  }
 
   ret = pipe(user_data->pipe);
   if (ret == -1) {
@@ -341,6 +919,54 @@ int init(int *width, int *height, int *err)
     goto fail;
   }
 
+  user_data->device_list.next = &user_data->device_list;
+  user_data->device_list.prev = &user_data->device_list;
+
+  user_data->epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (user_data->epoll == -1) {
+    printf("epoll_create1 failed: %s\n", strerror(errno));
+    goto fail;
+  }
+
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events = EPOLLIN;
+  event.data.fd = user_data->pipe[0];
+  epoll_ctl(user_data->epoll, EPOLL_CTL_ADD, user_data->pipe[0], &event);
+
+  /* KEYBOARD and MOUSE select the input devices, otherwise all the keyboards and pointers are used and followed */
+  if (getenv("KEYBOARD") || getenv("MOUSE")) {
+    if (getenv("KEYBOARD") && !device_open(user_data, getenv("KEYBOARD"), 0)) {
+      printf("open %s failed: %s\n", getenv("KEYBOARD"), strerror(errno));
+      goto fail;
+    }
+    if (getenv("MOUSE") && !device_open(user_data, getenv("MOUSE"), 0)) {
+      printf("open %s failed: %s\n", getenv("MOUSE"), strerror(errno));
+      goto fail;
+    }
+  }
+  else {
+    /* watched before the scan, a device plugged meanwhile is not missed */
+    user_data->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (user_data->inotify != -1 && inotify_add_watch(user_data->inotify, "/dev/input", IN_CREATE | IN_ATTRIB | IN_DELETE) != -1) {
+      event.data.fd = user_data->inotify;
+      epoll_ctl(user_data->epoll, EPOLL_CTL_ADD, user_data->inotify, &event);
+    }
+    else {
+      printf("inotify on /dev/input failed: %s\n", strerror(errno));
+    }
+
+    dir = opendir("/dev/input");
+    if (dir) {
+      while ((entry = readdir(dir))) {
+        if (!strncmp(entry->d_name, "event", 5)) {
+          snprintf(path, sizeof(path), "/dev/input/%.52s", entry->d_name);
+          device_open(user_data, path, 1);
+        }
+      }
+      closedir(dir);
+    }
+  }
+
   pthread_create(&user_data->thread, NULL, input_thread, user_data);
 
   *width = info.xres;
@@ -351,15 +977,27 @@ int init(int *width, int *height, int *err)
   return fb;
 
 fail:
+  if (user_data && user_data_get(fb) == user_data) {
+    user_data_clear(fb);
+  }
   if (user_data) {
-    if (user_data->mouse != -1) {
-      close(user_data->mouse);
+    if (user_data->event_fd != -1) {
+      close(user_data->event_fd);
+    }
+    if (user_data->device_list.next) {
+      devices_close(user_data);
     }
-    if (user_data->keyboard != -1) {
-      close(user_data->keyboard);
+    if (user_data->pipe[0] != -1) {
+      close(user_data->pipe[0]);
+      close(user_data->pipe[1]);
     }
-    if (user_data->cursor) {
-      free(user_data->cursor);
+    pthread_mutex_destroy(&user_data->cursor_mutex);
+    free(user_data->cursor);
+    free(user_data->cursor_mask);
+    free(user_data->cursor_under);
+    free(user_data->cursor_row);
+    if (user_data->screen) {
+      munmap(user_data->screen, user_data->w * user_data->h * user_data->bpp);
     }
     free(user_data);
   }
@@ -373,16 +1011,14 @@ fail:
 int create_window(int dpy, int posx, int posy, int width, int height, int opt, int *err)
 {
   int fb = dpy;
-  struct fb_var_screeninfo info;
   struct fb_user_data *user_data = NULL;
   struct fb_window *window = NULL;
   struct fb_list *window_link = NULL;
-  struct fb_event *event = NULL;
-  struct fb_list *event_link = NULL;
 
-  memset(&info, 0, sizeof(struct fb_var_screeninfo));
-  ioctl(fb, FBIOGET_VSCREENINFO, &info);
-  user_data = (struct fb_user_data *)(long)info.reserved[0];
+  user_data = user_data_get(fb);
+  if (!user_data) {
+    goto fail;
+  }
 
   window = calloc(1, sizeof(struct fb_window));
   if (!window) {
@@ -396,76 +1032,206 @@ int create_window(int dpy, int posx, int posy, int width, int height, int opt, i
     window->posy = posy;
   }
 
+  window->expose = 1;
+
+  pthread_mutex_lock(&user_data->window_mutex);
   window_link = &window->link;
   window_link->next = user_data->window_list.next;
   window_link->prev = &user_data->window_list;
   user_data->window_list.next->prev = window_link;
   user_data->window_list.next = window_link;
+  user_data->expose = 1;
+  pthread_mutex_unlock(&user_data->window_mutex);
 
-  event = calloc(1, sizeof(struct fb_event));
-  if (!event) {
-    printf("event calloc failed\n");
-    goto fail;
-  }
-
-  event->type = FB_EVENT_EXPOSE;
-  event->window = window;
-  event_link = &event->link;
-  event_link->next = user_data->event_list.next;
-  event_link->prev = &user_data->event_list;
-  user_data->event_list.next->prev = event_link;
-  user_data->event_list.next = event_link;
+  event_signal(user_data);
 
   *err = 0;
 
   return (long)window;
 
 fail:
-  if (window) {
-    if (window_link) {
-      window_link->next->prev = window_link->prev;
-      window_link->prev->next = window_link->next;
-    }
-    free(window);
-  }
   *err = -1;
   return 0;
 }
 
 void destroy_window(int dpy, int win)
 {
+  int fb = dpy;
+  struct fb_user_data *user_data = NULL;
   struct fb_window *window = (struct fb_window *)(long)win;
   struct fb_list *window_link = NULL;
 
+  user_data = user_data_get(fb);
+  if (!user_data) {
+    return;
+  }
+
+  pthread_mutex_lock(&user_data->window_mutex);
   window_link = &window->link;
   window_link->next->prev = window_link->prev;
   window_link->prev->next = window_link->next;
+  pthread_mutex_unlock(&user_data->window_mutex);
+
+  /* the windows below are uncovered */
+  if (user_data->shadow && window->pixels) {
+    pthread_mutex_lock(&user_data->cursor_mutex);
+    screen_compose(user_data, window->posx, window->posy, window->posx + window->width, window->posy + window->height);
+    pthread_mutex_unlock(&user_data->cursor_mutex);
+  }
+
+  free(window->pixels);
   free(window);
 }
 
+int get_refresh_rate(int dpy)
+{
+  int fb = dpy;
+  struct fb_user_data *user_data = NULL;
+
+  user_data = user_data_get(fb);
+  if (!user_data) {
+    return 0;
+  }
+
+  return user_data->refresh_rate;
+}
+
+/* called by the backends before a window is swapped on the framebuffer, sleeps until the next estimated vblank
+   when the driver can not wait for it */
+void wait_vsync(int dpy)
+{
+  int fb = dpy;
+  struct fb_user_data *user_data = NULL;
+  struct timespec ts;
+  unsigned int crtc = 0;
+  long long now = 0, next = 0;
+
+  user_data = user_data_get(fb);
+  if (!user_data) {
+    return;
+  }
+
+  if (atomic_load_explicit(&user_data->vsync, memory_order_relaxed)) {
+    if (!ioctl(fb, FBIO_WAITFORVSYNC, &crtc)) {
+      return;
+    }
+    if (atomic_exchange(&user_data->vsync, 0)) {
+      printf("ioctl FBIO_WAITFORVSYNC failed: %s\n", strerror(errno));
+    }
+  }
+
+  now = fb_time();
+  next = user_data->vsync_time + ((now - user_data->vsync_time) / user_data->refresh + 1) * user_data->refresh;
+  ts.tv_sec = next / 1000000000LL;
+  ts.tv_nsec = next % 1000000000LL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+/* called by the backends once a window has been swapped on the framebuffer */
+void swap_window(int dpy, int win)
+{
+  int fb = dpy;
+  struct fb_user_data *user_data = NULL;
+  struct fb_window *window = (struct fb_window *)(long)win;
+
+  user_data = user_data_get(fb);
+  if (!user_data) {
+    return;
+  }
+
+  atomic_store_explicit(&user_data->swap_time, fb_time(), memory_order_relaxed);
+
+  if (user_data->shadow && window->pixels) {
+    pthread_mutex_lock(&user_data->cursor_mutex);
+    screen_compose(user_data, window->posx, window->posy, window->posx + window->width, window->posy + window->height);
+    pthread_mutex_unlock(&user_data->cursor_mutex);
+    if (atomic_load_explicit(&user_data->cursor_dirty, memory_order_acquire)) {
+      cursor_composite(user_data, NULL);
+    }
+    return;
+  }
+
+  cursor_composite(user_data, window);
+}
+
+/* in compositor mode, the pixels the backend renders the window in instead of the framebuffer,
+   the screen is composed from then on */
+void *get_window_buffer(int dpy, int win, int *stride)
+{
+  int fb = dpy;
+  struct fb_user_data *user_data = NULL;
+  struct fb_window *window = (struct fb_window *)(long)win;
+
+  user_data = user_data_get(fb);
+  if (!user_data) {
+    return NULL;
+  }
+
+  if (!user_data->compositor) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&user_data->cursor_mutex);
+
+  if (!user_data->shadow) {
+    user_data->shadow = calloc(user_data->w * user_data->h, user_data->bpp);
+    user_data->compose_row = calloc(user_data->w, user_data->bpp);
+    if (!user_data->shadow || !user_data->compose_row) {
+      printf("shadow calloc failed\n");
+      free(user_data->shadow);
+      free(user_data->compose_row);
+      user_data->shadow = NULL;
+      user_data->compose_row = NULL;
+      pthread_mutex_unlock(&user_data->cursor_mutex);
+      return NULL;
+    }
+    memset(user_data->screen, 0, user_data->w * user_data->h * user_data->bpp);
+    user_data->cursor_drawn = 0;
+    atomic_store_explicit(&user_data->cursor_dirty, 1, memory_order_release);
+  }
+
+  pthread_mutex_unlock(&user_data->cursor_mutex);
+
+  if (!window->pixels) {
+    window->stride = window->width * user_data->bpp;
+    window->pixels = calloc(window->height, window->stride);
+    if (!window->pixels) {
+      printf("window pixels calloc failed\n");
+      return NULL;
+    }
+  }
+
+  *stride = window->stride;
+
+  return window->pixels;
+}
+
 void fini(int dpy)
 {
   int fb = dpy;
-  struct fb_var_screeninfo info;
   struct fb_user_data *user_data = NULL;
-  struct fb_event *event = NULL;
-  struct fb_list *event_link = NULL;
 
-  memset(&info, 0, sizeof(struct fb_var_screeninfo));
-  ioctl(fb, FBIOGET_VSCREENINFO, &info);
-  user_data = (struct fb_user_data *)(long)info.reserved[0];
-  for (event_link = user_data->event_list.next; event_link != &user_data->event_list; event_link = event_link->next) {
-    event_link->next->prev = event_link->prev;
-    event_link->prev->next = event_link->next;
-    free(event);
+  user_data = user_data_get(fb);
+  if (!user_data) {
+    return;
   }
+
+  user_data_clear(fb);
   write(user_data->pipe[1], "", 1);
   pthread_join(user_data->thread, NULL);
+  pthread_mutex_destroy(&user_data->window_mutex);
   close(user_data->pipe[0]);
   close(user_data->pipe[1]);
-  close(user_data->mouse);
-  close(user_data->keyboard);
+  close(user_data->event_fd);
+  devices_close(user_data);
+  pthread_mutex_destroy(&user_data->cursor_mutex);
   free(user_data->cursor);
+  free(user_data->cursor_mask);
+  free(user_data->cursor_under);
+  free(user_data->cursor_row);
+  free(user_data->shadow);
+  free(user_data->compose_row);
+  munmap(user_data->screen, user_data->w * user_data->h * user_data->bpp);
   free(user_data);
   close(fb);
 }
@@ -511,75 +1277,147 @@ static int keymap[] = {
   [ KEY_Z ] = 0x7A,
 };
 
-int get_event(int dpy, int *type, int *key, int *x, int *y)
+int get_events(int dpy, struct event *events, int count)
 {
   int fb = dpy;
-  struct fb_var_screeninfo info;
   struct fb_user_data *user_data = NULL;
-  struct fb_event *event = NULL;
-  struct fb_list *event_link = NULL;
-  int win = 0;
+  struct fb_window *window = NULL;
+  struct fb_list *window_link = NULL;
+  struct fb_event *event = NULL, motion;
+  eventfd_t value = 0;
+  unsigned int head = 0, tail = 0;
+  long long now = 0;
+  int key = 0, n = 0, taken = 0;
 
-  *type = EVENT_NONE;
-  *key = *x = *y = 0;
+  user_data = user_data_get(fb);
+  if (!user_data) {
+    return 0;
+  }
 
-  memset(&info, 0, sizeof(struct fb_var_screeninfo));
-  ioctl(fb, FBIOGET_VSCREENINFO, &info);
-  user_data = (struct fb_user_data *)(long)info.reserved[0];
+  /* nothing has been swapped in the last refresh period to composite the moved cursor */
+  if (user_data->cursor_dirty) {
+    now = fb_time();
+    if (now - user_data->cursor_time >= user_data->refresh && now - user_data->swap_time >= user_data->refresh) {
+      cursor_composite(user_data, NULL);
+    }
+  }
 
-  event_link = &user_data->event_list;
-  while (event_link->next != &user_data->event_list) {
-    event_link = event_link->next;
+  tail = atomic_load_explicit(&user_data->tail, memory_order_relaxed);
+
+  /* the queue is checked again after the eventfd is cleared, the input thread may have pushed in between */
+  if (atomic_load_explicit(&user_data->head, memory_order_acquire) == tail && !user_data->motion.pending && !user_data->expose && user_data->event_fd_signaled) {
+    user_data->event_fd_signaled = 0;
+    eventfd_read(user_data->event_fd, &value);
   }
 
-  if (event_link != &user_data->event_list) {
-    event = (struct fb_event *)((char *)event_link - (char *)&((struct fb_event *)NULL)->link);
-    if (event->type == FB_EVENT_EXPOSE) {
-      *type = EVENT_DISPLAY;
+  if (user_data->expose) {
+    pthread_mutex_lock(&user_data->window_mutex);
+    user_data->expose = 0;
+    for (window_link = user_data->window_list.next; window_link != &user_data->window_list; window_link = window_link->next) {
+      window = (struct fb_window *)((char *)window_link - (char *)&((struct fb_window *)NULL)->link);
+      if (!window->expose) {
+        continue;
+      }
+      if (n == count) {
+        user_data->expose = 1;
+        break;
+      }
+      memset(&events[n], 0, sizeof(struct event));
+      events[n].win = (long)window;
+      events[n].type = EVENT_DISPLAY;
+      window->expose = 0;
+      n++;
     }
-    else if (event->type == FB_EVENT_KEYBOARD) {
+    pthread_mutex_unlock(&user_data->window_mutex);
+  }
+
+  head = atomic_load_explicit(&user_data->head, memory_order_acquire);
+
+  while (n < count) {
+    if (tail != head) {
+      event = &user_data->events[tail & (EVENTS_SIZE - 1)];
+      tail++;
+    }
+    else if (atomic_load_explicit(&user_data->motion.pending, memory_order_acquire)) {
+      /* taken once the events queued before it are, the input thread may have requeued it meanwhile */
+      pthread_mutex_lock(&user_data->window_mutex);
+      taken = atomic_load_explicit(&user_data->motion.pending, memory_order_relaxed) && user_data->motion.pos == tail;
+      if (taken) {
+        motion_take(&user_data->motion, &motion);
+      }
+      pthread_mutex_unlock(&user_data->window_mutex);
+      if (!taken) {
+        head = atomic_load_explicit(&user_data->head, memory_order_acquire);
+        if (head == tail) {
+          break;
+        }
+        continue;
+      }
+      event = &motion;
+    }
+    else {
+      break;
+    }
+
+    memset(&events[n], 0, sizeof(struct event));
+    events[n].win = (long)event->window;
+    events[n].time = event->time;
+    if (event->type == FB_EVENT_KEYBOARD) {
       switch (event->keycode) {
-        case KEY_F1:            *key = F1;        break;
-        case KEY_F2:            *key = F2;        break;
-        case KEY_F3:            *key = F3;        break;
-        case KEY_F4:            *key = F4;        break;
-        case KEY_F5:            *key = F5;        break;
-        case KEY_F6:            *key = F6;        break;
-        case KEY_F7:            *key = F7;        break;
-        case KEY_F8:            *key = F8;        break;
-        case KEY_F9:            *key = F9;        break;
-        case KEY_F10:           *key = F10;       break;
-        case KEY_F11:           *key = F11;       break;
-        case KEY_F12:           *key = F12;       break;
-        case KEY_LEFT:          *key = LEFT;      break;
-        case KEY_UP:            *key = UP;        break;
-        case KEY_RIGHT:         *key = RIGHT;     break;
-        case KEY_DOWN:          *key = DOWN;      break;
-        case KEY_PAGEUP:        *key = PAGE_UP;   break;
-        case KEY_PAGEDOWN:      *key = PAGE_DOWN; break;
-        default:                *key = 0;         break;
+        case KEY_F1:            key = F1;         break;
+        case KEY_F2:            key = F2;         break;
+        case KEY_F3:            key = F3;         break;
+        case KEY_F4:            key = F4;         break;
+        case KEY_F5:            key = F5;         break;
+        case KEY_F6:            key = F6;         break;
+        case KEY_F7:            key = F7;         break;
+        case KEY_F8:            key = F8;         break;
+        case KEY_F9:            key = F9;         break;
+        case KEY_F10:           key = F10;        break;
+        case KEY_F11:           key = F11;        break;
+        case KEY_F12:           key = F12;        break;
+        case KEY_LEFT:          key = LEFT;       break;
+        case KEY_UP:            key = UP;         break;
+        case KEY_RIGHT:         key = RIGHT;      break;
+        case KEY_DOWN:          key = DOWN;       break;
+        case KEY_PAGEUP:        key = PAGE_UP;    break;
+        case KEY_PAGEDOWN:      key = PAGE_DOWN;  break;
+        default:                key = 0;          break;
       }
-      if (!*key) {
-        *key = keymap[event->keycode];
-        *type = EVENT_KEYBOARD;
+      if (!key) {
+        events[n].key = event->keycode < sizeof(keymap) / sizeof(keymap[0]) ? keymap[event->keycode] : 0;
+        events[n].type = EVENT_KEYBOARD;
       }
       else {
-        *type = EVENT_SPECIAL;
+        events[n].key = key;
+        events[n].type = EVENT_SPECIAL;
       }
     }
     else if (event->type == FB_EVENT_MOUSE) {
-      *x = event->x;
-      *y = event->y;
-      *type = EVENT_PASSIVEMOTION;
+      events[n].x = event->x;
+      events[n].y = event->y;
+      events[n].type = EVENT_PASSIVEMOTION;
+    }
+
+    atomic_store_explicit(&user_data->tail, tail, memory_order_release);
+
+    if (events[n].type) {
+      n++;
     }
   }
 
-  if (*type) {
-    win = (long)event->window;
-    event_link->next->prev = event_link->prev;
-    event_link->prev->next = event_link->next;
-    free(event);
+  return n;
+}
+
+int get_event_fd(int dpy)
+{
+  int fb = dpy;
+  struct fb_user_data *user_data = NULL;
+
+  user_data = user_data_get(fb);
+  if (!user_data) {
+    return -1;
   }
 
-  return win;
+  return user_data->event_fd;
 }
@@ -32,6 +32,7 @@
 #include <sys/mman.h>
 #include <GL/glfbdev.h>
 #include "attributes.h"
+#include "event.h"
 
 #ifdef FIU_ENABLE
 #include <fiu-local.h>
@@ -49,7 +50,12 @@ int init(int *width, int *height, int *err);
 int create_window(int dpy, int posx, int posy, int width, int height, int opt, int *err);
 void destroy_window(int dpy, int win);
 void fini(int dpy);
-int get_event(int dpy, int *type, int *key, int *x, int *y);
+int get_events(int dpy, struct event *events, int count);
+int get_event_fd(int dpy);
+int get_refresh_rate(int dpy);
+void wait_vsync(int dpy);
+void swap_window(int dpy, int win);
+void *get_window_buffer(int dpy, int win, int *stride);
 
 typedef struct {
   int fbdev_dpy;
@@ -60,6 +66,7 @@ typedef struct {
   int fbdev_win;
   GLFBDevContextPtr glfbdev_ctx;
   void *fbdev_buffer;
+  int composited;
   void *glfbdev_buffer;
   struct attributes attribs;
 } glutWindow;
@@ -84,6 +91,8 @@ int Init()
   glut_dpy->attribs.win_width = glut_dpy->attribs.dpy_width;
   glut_dpy->attribs.win_height = glut_dpy->attribs.dpy_height;
 
+  glut_dpy->attribs.refresh_rate = get_refresh_rate(glut_dpy->fbdev_dpy);
+
   return (long)glut_dpy;
 
 error:
@@ -133,7 +142,7 @@ int CreateWindow(int display)
   struct fb_fix_screeninfo fbdev_finfo;
   struct fb_var_screeninfo fbdev_vinfo;
   int glfbdev_visual_attr[4];
-  int i = 0;
+  int i = 0, stride = 0;
 
   glut_win = calloc(1, sizeof(glutWindow));
   FIU_CHECK(glut_win);
@@ -178,10 +187,22 @@ int CreateWindow(int display)
     goto error;
   }
 
-  glut_win->fbdev_buffer = mmap(NULL, fbdev_finfo.smem_len, PROT_WRITE, MAP_SHARED, glut_dpy->fbdev_dpy, 0);
-  if (glut_win->fbdev_buffer == MAP_FAILED) {
-    printf("mmap error: %s\n", strerror(errno));
-    goto error;
+  /* with the fbdev compositor, the window is rendered in its own pixels as in a framebuffer of its size */
+  glut_win->fbdev_buffer = get_window_buffer(glut_dpy->fbdev_dpy, glut_win->fbdev_win, &stride);
+  if (glut_win->fbdev_buffer) {
+    glut_win->composited = 1;
+    fbdev_vinfo.xres = fbdev_vinfo.xres_virtual = glut_win->attribs.win_width;
+    fbdev_vinfo.yres = fbdev_vinfo.yres_virtual = glut_win->attribs.win_height;
+    fbdev_vinfo.xoffset = fbdev_vinfo.yoffset = 0;
+    fbdev_finfo.line_length = stride;
+    fbdev_finfo.smem_len = stride * glut_win->attribs.win_height;
+  }
+  else {
+    glut_win->fbdev_buffer = mmap(NULL, fbdev_finfo.smem_len, PROT_WRITE, MAP_SHARED, glut_dpy->fbdev_dpy, 0);
+    if (glut_win->fbdev_buffer == MAP_FAILED) {
+      printf("mmap error: %s\n", strerror(errno));
+      goto error;
+    }
   }
 
   glut_win->glfbdev_buffer = glFBDevCreateBuffer(&fbdev_finfo, &fbdev_vinfo, glfbdev_visual, glut_win->fbdev_buffer, NULL, fbdev_finfo.smem_len);
@@ -217,7 +238,7 @@ error:
   if (glut_win->glfbdev_buffer) {
     glFBDevDestroyBuffer(glut_win->glfbdev_buffer);
   }
-  if (glut_win->fbdev_buffer) {
+  if (glut_win->fbdev_buffer && !glut_win->composited) {
     munmap(glut_win->fbdev_buffer, fbdev_finfo.smem_len);
   }
   if (glut_win->fbdev_win) {
@@ -248,9 +269,16 @@ void SetWindow(int display, int window, int context)
 
 void SwapBuffers(int display, int window)
 {
+  glutDisplay *glut_dpy = (glutDisplay *)(long)display;
   glutWindow *glut_win = (glutWindow *)(long)window;
 
+  if (glut_win->attribs.double_buffer) {
+    wait_vsync(glut_dpy->fbdev_dpy);
+  }
+
   glFBDevSwapBuffers(glut_win->glfbdev_buffer);
+
+  swap_window(glut_dpy->fbdev_dpy, glut_win->fbdev_win);
 }
 
 struct attributes *GetDisplayAttribs(int display)
@@ -277,8 +305,10 @@ void DestroyWindow(int display, int window)
 
   glFBDevDestroyBuffer(glut_win->glfbdev_buffer);
 
-  ioctl(glut_dpy->fbdev_dpy, FBIOGET_FSCREENINFO, &fbdev_finfo);
-  munmap(glut_win->fbdev_buffer, fbdev_finfo.smem_len);
+  if (!glut_win->composited) {
+    ioctl(glut_dpy->fbdev_dpy, FBIOGET_FSCREENINFO, &fbdev_finfo);
+    munmap(glut_win->fbdev_buffer, fbdev_finfo.smem_len);
+  }
 
   destroy_window(glut_dpy->fbdev_dpy, glut_win->fbdev_win);
 
@@ -294,9 +324,16 @@ void Fini(int display)
   free(glut_dpy);
 }
 
-int GetEvent(int display, int *type, int *key, int *x, int *y)
+int GetEvents(int display, struct event *events, int count)
+{
+  glutDisplay *glut_dpy = (glutDisplay *)(long)display;
+
+  return get_events(glut_dpy->fbdev_dpy, events, count);
+}
+
+int GetEventFd(int display)
 {
   glutDisplay *glut_dpy = (glutDisplay *)(long)display;
 
-  return get_event(glut_dpy->fbdev_dpy, type, key, x, y);
+  return get_event_fd(glut_dpy->fbdev_dpy);
 }
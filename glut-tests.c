@@ -30,17 +30,37 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <linux/uinput.h>
 #include "glut.h"
 
 static int glut_win = 0, uinput_keyboard = 0, uinput_mouse = 0;
+static int glut_win_thread = 0, redisplay_count = 0, destroy_count = 0;
+static int timer_values[64], timer_count = 0;
 
 static void sighandler_quit(int signum)
 {
   glutLeaveMainLoop();
 }
 
+static void sighandler_key(int signum)
+{
+  struct input_event event;
+
+  memset(&event, 0, sizeof(struct input_event));
+
+  event.type = EV_KEY;
+  event.code = KEY_Q;
+  event.value = 1;
+  write(uinput_keyboard, &event, sizeof(struct input_event));
+  event.value = 0;
+  write(uinput_keyboard, &event, sizeof(struct input_event));
+  event.type = EV_SYN;
+  event.code = SYN_REPORT;
+  write(uinput_keyboard, &event, sizeof(struct input_event));
+}
+
 static void sighandler_input(int signum)
 {
   struct input_event event;
@@ -79,6 +99,26 @@ static void sighandler_input(int signum)
   write(uinput_keyboard, &event, sizeof(struct input_event));
 }
 
+static int uinput_keyboard_create()
+{
+  struct uinput_user_dev dev;
+  int fd, i;
+
+  memset(&dev, 0, sizeof(struct uinput_user_dev));
+  fd = open("/dev/uinput", O_WRONLY);
+  strcpy(dev.name, "uinput-keyboard");
+  write(fd, &dev, sizeof(struct uinput_user_dev));
+  ioctl(fd, UI_SET_EVBIT, EV_KEY);
+  for (i = KEY_Q; i <= KEY_M; i++) {
+    ioctl(fd, UI_SET_KEYBIT, i);
+  }
+  ioctl(fd, UI_SET_KEYBIT, KEY_ESC);
+  ioctl(fd, UI_SET_KEYBIT, KEY_F1);
+  ioctl(fd, UI_DEV_CREATE);
+
+  return fd;
+}
+
 static void glutReshape(int width, int height)
 {
 }
@@ -91,6 +131,15 @@ static void glutIdle()
 {
 }
 
+static void glutTimer(int value)
+{
+}
+
+static void glutTimerRecord(int value)
+{
+  timer_values[timer_count++] = value;
+}
+
 static void glutKeyboard(unsigned char key, int x, int y)
 {
   switch (key) {
@@ -114,6 +163,58 @@ static void glutPassiveMotion(int x, int y)
   printf("x = %d, y = %d\n", x, y);
 }
 
+static void glutPassiveMotionHistory(int count, int *x, int *y)
+{
+  printf("count = %d, x = %d, y = %d\n", count, x[count - 1], y[count - 1]);
+}
+
+static void glutKeyboardRedisplay(unsigned char key, int x, int y)
+{
+  glutPostRedisplay();
+}
+
+static void glutDisplayLatency()
+{
+  glutSwapBuffers();
+  if (glutGet(GLUT_INPUT_LATENCY_COUNT)) {
+    glutLeaveMainLoop();
+  }
+}
+
+/* render thread callbacks */
+
+static void glutDisplayRedisplay()
+{
+  if (++redisplay_count < 3) {
+    glutPostRedisplay();
+  }
+}
+
+static void glutDisplayDestroy()
+{
+  glutDestroyWindow(glut_win_thread);
+  destroy_count++;
+}
+
+static void glutTimerCreateWindow(int value)
+{
+  glut_win_thread = glutCreateWindow(NULL);
+  glutDisplayFunc(glutDisplayDestroy);
+}
+
+static void glutTimerDestroyWindow(int value)
+{
+  int win = glutCreateWindow(NULL);
+
+  glutDestroyWindow(win);
+  destroy_count++;
+}
+
+static void glutTimerQuit(int value)
+{
+  glutLeaveMainLoop();
+}
+
 /* glutInit test */
 
 START_TEST(test_glutInit)
@@ -138,6 +239,30 @@ START_TEST(test_glutInit)
 }
 END_TEST
 
+/* glutInitDevice test */
+
+START_TEST(test_glutInitDevice)
+{
+  glutInit(NULL, NULL);
+  glutInitDevice("0");
+  ck_assert_int_eq(glutGetError(), GLUT_DISPLAY_EXIST);
+  glutExit();
+
+  /* only the egl backend fails, the other ones can not select a device and ignore it */
+  glutInitDevice("no-such-device");
+  glutInit(NULL, NULL);
+  if (getenv("GLUT_BACKEND") && !strcmp(getenv("GLUT_BACKEND"), "egl")) {
+    ck_assert_int_eq(glutGetError(), GLUT_BAD_DISPLAY);
+  }
+  else if (glutGetError() == GLUT_SUCCESS) {
+    glutExit();
+  }
+
+  glutInitDevice(NULL);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+}
+END_TEST
+
 /* glutInitWindowPosition test */
 
 START_TEST(test_glutInitWindowPosition)
@@ -234,6 +359,14 @@ START_TEST(test_glutSetWindow)
   ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
 
   glutDestroyWindow(glut_win);
+  glutSetWindow(glut_win);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_VALUE);
+
+  int glut_win3 = glutCreateWindow(NULL);
+  glutSetWindow(glut_win);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_VALUE);
+
+  glutDestroyWindow(glut_win3);
   glutDestroyWindow(glut_win2);
   glutExit();
 }
@@ -329,6 +462,56 @@ START_TEST(test_glutIdleFunc)
 }
 END_TEST
 
+/* glutTimerFunc test */
+
+START_TEST(test_glutTimerFunc)
+{
+  int i = 0, n = 0, delay = 0;
+
+  glutTimerFunc(0, glutTimer, 0);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_DISPLAY);
+
+  glutInit(NULL, NULL);
+
+  glutTimerFunc(0, NULL, 0);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_VALUE);
+
+  fiu_enable("ENOMEM", 1, NULL, FIU_ONETIME);
+  glutTimerFunc(0, glutTimer, 0);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_ALLOC);
+
+  glutTimerFunc(0, glutTimer, 0);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutExit();
+
+  /* out of order and equal delays, more timers than the initial heap size,
+     they fire by deadline, those with equal delays in registration order, with their values */
+  glutInit(NULL, NULL);
+  glut_win = glutCreateWindow(NULL);
+  for (i = 0; i < 40; i++) {
+    glutTimerFunc(i * 7 % 10 * 5, glutTimerRecord, i);
+    ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+  }
+  glutTimerFunc(200, glutTimerQuit, 0);
+  glutMainLoop();
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  ck_assert_int_eq(timer_count, 40);
+  for (delay = 0, n = 0; delay < 10; delay++) {
+    for (i = 0; i < 40; i++) {
+      if (i * 7 % 10 == delay) {
+        ck_assert_int_eq(timer_values[n++], i);
+      }
+    }
+  }
+
+  glutDestroyWindow(glut_win);
+  glutExit();
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+}
+END_TEST
+
 /* glutKeyboardFunc test */
 
 START_TEST(test_glutKeyboardFunc)
@@ -383,6 +566,24 @@ START_TEST(test_glutPassiveMotionFunc)
 }
 END_TEST
 
+/* glutPassiveMotionHistoryFunc test */
+
+START_TEST(test_glutPassiveMotionHistoryFunc)
+{
+  glutPassiveMotionHistoryFunc(glutPassiveMotionHistory);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_WINDOW);
+
+  glutInit(NULL, NULL);
+  glut_win = glutCreateWindow(NULL);
+
+  glutPassiveMotionHistoryFunc(glutPassiveMotionHistory);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutDestroyWindow(glut_win);
+  glutExit();
+}
+END_TEST
+
 /* glutSwapBuffers test */
 
 START_TEST(test_glutSwapBuffers)
@@ -401,6 +602,28 @@ START_TEST(test_glutSwapBuffers)
 }
 END_TEST
 
+/* glutSetTargetFrameRate test */
+
+START_TEST(test_glutSetTargetFrameRate)
+{
+  glutSetTargetFrameRate(60);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_DISPLAY);
+
+  glutInit(NULL, NULL);
+
+  glutSetTargetFrameRate(-1);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_VALUE);
+
+  glutSetTargetFrameRate(60);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutSetTargetFrameRate(0);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutExit();
+}
+END_TEST
+
 /* glutPostRedisplay test */
 
 START_TEST(test_glutPostRedisplay)
@@ -420,6 +643,28 @@ START_TEST(test_glutPostRedisplay)
 }
 END_TEST
 
+/* glutPostWindowRedisplay test */
+
+START_TEST(test_glutPostWindowRedisplay)
+{
+  glutPostWindowRedisplay(0);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_WINDOW);
+
+  glutInit(NULL, NULL);
+  glut_win = glutCreateWindow(NULL);
+
+  glutPostWindowRedisplay(0);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_VALUE);
+
+  glutDisplayFunc(glutDisplay);
+  glutPostWindowRedisplay(glut_win);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutDestroyWindow(glut_win);
+  glutExit();
+}
+END_TEST
+
 /* glutGet test */
 
 START_TEST(test_glutGet)
@@ -462,8 +707,36 @@ START_TEST(test_glutGet)
   glutGet(GLUT_WINDOW_DEPTH_SIZE);
   ck_assert_int_eq(glutGetError(), GLUT_BAD_WINDOW);
 
+  glutGet(GLUT_FRAME_TIME_P99);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_WINDOW);
+
+  glutGet(GLUT_FRAMES_DROPPED);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutGet(GLUT_DISPATCH_TIME);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
   glut_win = glutCreateWindow(NULL);
 
+  ck_assert_int_eq(glutGet(GLUT_FRAME_TIME_AVG), 0);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutSwapBuffers();
+  usleep(10000);
+  glutSwapBuffers();
+  usleep(10000);
+  glutSwapBuffers();
+
+  ck_assert_int_ge(glutGet(GLUT_FRAME_TIME_MIN), 10000);
+  ck_assert_int_ge(glutGet(GLUT_FRAME_TIME_AVG), glutGet(GLUT_FRAME_TIME_MIN));
+  ck_assert_int_ge(glutGet(GLUT_FRAME_TIME_P99), glutGet(GLUT_FRAME_TIME_P50));
+  ck_assert_int_ge(glutGet(GLUT_FRAME_TIME_P95), glutGet(GLUT_FRAME_TIME_P50));
+  ck_assert_int_ge(glutGet(GLUT_SWAP_TIME), 0);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutGet(GLUT_DISPLAY_TIME);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
   glutGet(GLUT_WINDOW_X);
   ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
 
@@ -487,6 +760,94 @@ START_TEST(test_glutGet)
 }
 END_TEST
 
+/* glutGet64 test */
+
+START_TEST(test_glutGet64)
+{
+  long long t = 0;
+
+  glutGet64(0);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_VALUE);
+
+  t = glutGet64(GLUT_ELAPSED_TIME_NS);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+  usleep(100000);
+  ck_assert(glutGet64(GLUT_ELAPSED_TIME_NS) - t >= 100000000LL);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutGet64(GLUT_ELAPSED_TIME);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutGet64(GLUT_SCREEN_WIDTH);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_DISPLAY);
+}
+END_TEST
+
+/* glutGetString test */
+
+START_TEST(test_glutGetString)
+{
+  glutGetString(0);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_VALUE);
+
+  glutGetString(GLUT_DEVICE_NAME);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_DISPLAY);
+
+  glutInit(NULL, NULL);
+
+  ck_assert_ptr_nonnull(glutGetString(GLUT_DEVICE_NAME));
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  ck_assert_int_lt(glutGet(GLUT_DEVICE_INDEX), glutGet(GLUT_DEVICE_COUNT));
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutExit();
+}
+END_TEST
+
+/* glutDumpInputLatency test */
+
+START_TEST(test_glutDumpInputLatency)
+{
+  glutDumpInputLatency();
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_WINDOW);
+
+  glutInit(NULL, NULL);
+  glut_win = glutCreateWindow(NULL);
+
+  glutDumpInputLatency();
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  ck_assert_int_eq(glutGet(GLUT_INPUT_LATENCY_COUNT), 0);
+  ck_assert_int_eq(glutGet(GLUT_INPUT_LATENCY_P99), 0);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutDestroyWindow(glut_win);
+  glutExit();
+
+  /* a key press is presented by the swap of the redisplay it posts */
+  uinput_keyboard = uinput_keyboard_create();
+  glutInit(NULL, NULL);
+  glut_win = glutCreateWindow(NULL);
+  glutKeyboardFunc(glutKeyboardRedisplay);
+  glutDisplayFunc(glutDisplayLatency);
+  signal(SIGALRM, sighandler_key);
+  alarm(1);
+  glutMainLoop();
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  ck_assert_int_eq(glutGet(GLUT_INPUT_LATENCY_COUNT), 1);
+  ck_assert_int_gt(glutGet(GLUT_INPUT_LATENCY_P50), 0);
+  glutDumpInputLatency();
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+
+  glutDestroyWindow(glut_win);
+  glutExit();
+  ioctl(uinput_keyboard, UI_DEV_DESTROY);
+  close(uinput_keyboard);
+}
+END_TEST
+
 /* glutDestroyWindow test */
 
 START_TEST(test_glutDestroyWindow)
@@ -532,8 +893,11 @@ END_TEST
 
 START_TEST(test_glutLeaveMainLoop)
 {
+  /* safe to call from a signal handler, so without a window it is a no-op that leaves the error untouched */
+  glutCreateWindow(NULL);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_DISPLAY);
   glutLeaveMainLoop();
-  ck_assert_int_eq(glutGetError(), GLUT_BAD_WINDOW);
+  ck_assert_int_eq(glutGetError(), GLUT_BAD_DISPLAY);
 
   glutInit(NULL, NULL);
   glut_win = glutCreateWindow(NULL);
@@ -546,12 +910,96 @@ START_TEST(test_glutLeaveMainLoop)
 }
 END_TEST
 
+/* glutMainLoop with render threads test */
+
+START_TEST(test_glutMainLoopThreads)
+{
+  setenv("GLUT_THREADS", "1", 1);
+  glutInit(NULL, NULL);
+  glut_win = glutCreateWindow(NULL);
+  glutDisplayFunc(glutDisplayRedisplay);
+  glutTimerFunc(0, glutTimerCreateWindow, 0);
+  glutTimerFunc(0, glutTimerDestroyWindow, 0);
+  glutTimerFunc(500, glutTimerQuit, 0);
+  glutMainLoop();
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+  ck_assert_int_eq(redisplay_count, 3);
+  ck_assert_int_eq(destroy_count, 2);
+  glutDestroyWindow(glut_win);
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+  glutExit();
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+  unsetenv("GLUT_THREADS");
+}
+END_TEST
+
+/* glutMainLoop with tracing test */
+
+START_TEST(test_glutMainLoopTrace)
+{
+  char path[] = "/tmp/glut-trace-XXXXXX", line[512];
+  FILE *file = NULL;
+  int fd = 0, len = 0, lines = 0, spans = 0, comma = 0, end = 0;
+
+  fd = mkstemp(path);
+  ck_assert_int_ne(fd, -1);
+  close(fd);
+
+  setenv("GLUT_TRACE", path, 1);
+  glutInit(NULL, NULL);
+  glut_win = glutCreateWindow(NULL);
+  glutDisplayFunc(glutDisplay);
+  glutTimerFunc(0, glutTimerQuit, 0);
+  glutMainLoop();
+  ck_assert_int_eq(glutGetError(), GLUT_SUCCESS);
+  glutDestroyWindow(glut_win);
+  glutExit();
+  unsetenv("GLUT_TRACE");
+
+  /* a JSON array with one trace event object per line */
+  file = fopen(path, "r");
+  ck_assert_ptr_nonnull(file);
+  while (fgets(line, sizeof(line), file)) {
+    len = strlen(line);
+    ck_assert_int_eq(line[len - 1], '\n');
+    line[--len] = 0;
+    ck_assert_int_eq(end, 0);
+    if (!lines) {
+      ck_assert_str_eq(line, "[");
+    }
+    else if (!strcmp(line, "]")) {
+      ck_assert_int_eq(comma, 0);
+      end = 1;
+    }
+    else {
+      ck_assert(lines == 1 || comma);
+      ck_assert_int_eq(line[0], '{');
+      comma = line[len - 1] == ',';
+      if (comma) {
+        line[--len] = 0;
+      }
+      ck_assert_int_eq(line[len - 1], '}');
+      if (strstr(line, "\"ph\":\"X\"")) {
+        ck_assert_ptr_nonnull(strstr(line, "\"ts\":"));
+        ck_assert_ptr_nonnull(strstr(line, "\"dur\":"));
+        spans++;
+      }
+    }
+    lines++;
+  }
+  fclose(file);
+  unlink(path);
+
+  ck_assert_int_eq(end, 1);
+  ck_assert_int_gt(spans, 0);
+}
+END_TEST
+
 /* glutMainLoop test */
 
 START_TEST(test_glutMainLoop)
 {
   struct uinput_user_dev dev;
-  int i;
 
   glutMainLoop();
   ck_assert_int_eq(glutGetError(), GLUT_BAD_WINDOW);
@@ -565,17 +1013,8 @@ START_TEST(test_glutMainLoop)
   glutDestroyWindow(glut_win);
   glutExit();
 
+  uinput_keyboard = uinput_keyboard_create();
   memset(&dev, 0, sizeof(struct uinput_user_dev));
-  uinput_keyboard = open("/dev/uinput", O_WRONLY);
-  strcpy(dev.name, "uinput-keyboard");
-  write(uinput_keyboard, &dev, sizeof(struct uinput_user_dev));
-  ioctl(uinput_keyboard, UI_SET_EVBIT, EV_KEY);
-  for (i = KEY_Q; i <= KEY_M; i++) {
-    ioctl(uinput_keyboard, UI_SET_KEYBIT, i);
-  }
-  ioctl(uinput_keyboard, UI_SET_KEYBIT, KEY_ESC);
-  ioctl(uinput_keyboard, UI_SET_KEYBIT, KEY_F1);
-  ioctl(uinput_keyboard, UI_DEV_CREATE);
   uinput_mouse = open("/dev/uinput", O_WRONLY);
   strcpy(dev.name, "uinput-mouse");
   write(uinput_mouse, &dev, sizeof(struct uinput_user_dev));
@@ -615,6 +1054,7 @@ int main()
   tc = tcase_create("Tests");
   tcase_set_timeout(tc, 10);
   tcase_add_test(tc, test_glutInit);
+  tcase_add_test(tc, test_glutInitDevice);
   tcase_add_test(tc, test_glutInitWindowPosition);
   tcase_add_test(tc, test_glutInitWindowSize);
   tcase_add_test(tc, test_glutInitDisplayMode);
@@ -625,15 +1065,24 @@ int main()
   tcase_add_test(tc, test_glutReshapeFunc);
   tcase_add_test(tc, test_glutDisplayFunc);
   tcase_add_test(tc, test_glutIdleFunc);
+  tcase_add_test(tc, test_glutTimerFunc);
   tcase_add_test(tc, test_glutKeyboardFunc);
   tcase_add_test(tc, test_glutSpecialFunc);
   tcase_add_test(tc, test_glutPassiveMotionFunc);
+  tcase_add_test(tc, test_glutPassiveMotionHistoryFunc);
   tcase_add_test(tc, test_glutSwapBuffers);
+  tcase_add_test(tc, test_glutSetTargetFrameRate);
   tcase_add_test(tc, test_glutPostRedisplay);
+  tcase_add_test(tc, test_glutPostWindowRedisplay);
   tcase_add_test(tc, test_glutGet);
+  tcase_add_test(tc, test_glutGet64);
+  tcase_add_test(tc, test_glutGetString);
+  tcase_add_test(tc, test_glutDumpInputLatency);
   tcase_add_test(tc, test_glutDestroyWindow);
   tcase_add_test(tc, test_glutExit);
   tcase_add_test(tc, test_glutLeaveMainLoop);
+  tcase_add_test(tc, test_glutMainLoopThreads);
+  tcase_add_test(tc, test_glutMainLoopTrace);
   tcase_add_test(tc, test_glutMainLoop);
   suite_add_tcase(s, tc);
   sr = srunner_create(s);
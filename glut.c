@@ -27,10 +27,18 @@
 #include <dirent.h>
 #include <dlfcn.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 #include "attributes.h"
 #include "event.h"
 #include "glut.h"
@@ -43,8 +51,11 @@
     free(ptr); \
     ptr = NULL; \
   }
+/* checked before a realloc, which must not be undone by freeing the still used block */
+#define FIU_FAIL() (fiu_init(0), fiu_fail("ENOMEM"))
 #else
 #define FIU_CHECK(ptr)
+#define FIU_FAIL() 0
 #endif
 
 typedef struct glutList {
@@ -52,23 +63,148 @@ typedef struct glutList {
   struct glutList *prev;
 } glutList;
 
+/* frame statistics cover the last SAMPLES_SIZE frames, times are in microseconds */
+#define SAMPLES_SIZE 128
+
+typedef struct {
+  int value[SAMPLES_SIZE];
+  int count, index;
+  long long sum;
+} glutSamples;
+
+/* log-scale buckets: exact below 16 us, then 16 buckets per power of two up to about 8 s */
+#define HISTOGRAM_SIZE 320
+
+/* input events delivered to a window and not yet presented by a swap */
+#define INPUT_PENDING_MAX 64
+
 typedef struct {
   glutList entry;
+  int id;
   int win;
+  int native_win;
   void *data;
-  void (*reshape_cb)();
-  void (*display_cb)();
-  void (*keyboard_cb)(unsigned char, int, int);
-  void (*special_cb)(int, int, int);
-  void (*passive_motion_cb)(int, int);
+  int redisplay;
+  /* set by any thread and called by the render thread of the window */
+  void (*_Atomic reshape_cb)();
+  void (*_Atomic display_cb)();
+  void (*_Atomic keyboard_cb)(unsigned char, int, int);
+  void (*_Atomic special_cb)(int, int, int);
+  void (*_Atomic passive_motion_cb)(int, int);
+  void (*_Atomic passive_motion_history_cb)(int, int *, int *);
+  glutList motion_entry;
+  int motion_pending;
+  int motion_x, motion_y;
+  int *motion_history_x, *motion_history_y;
+  int motion_history_count, motion_history_size;
+  pthread_t thread;
+  int thread_started;
+  atomic_int thread_stop;
+  int thread_redisplay;
+  pthread_mutex_t thread_mutex;
+  pthread_cond_t thread_cond;
+  struct event *thread_events;
+  int thread_events_count, thread_events_size;
+  long long last_swap;
+  glutSamples frame_samples, swap_samples, display_samples;
+  unsigned int frame_histogram[HISTOGRAM_SIZE];
+  long long input_time[INPUT_PENDING_MAX];
+  int input_count;
+  long long motion_time;
+  unsigned int latency_histogram[HISTOGRAM_SIZE];
+  unsigned int latency_count;
+  long long latency_sum;
 } glutWindowContext;
 
+typedef struct {
+  long long deadline;
+  unsigned int seq;
+  void (*func)(int);
+  int value;
+} glutTimer;
+
+typedef struct {
+  glutWindowContext *ctx;
+  int generation;
+  int next_free;
+} glutWindowSlot;
+
+typedef struct {
+  const char *name;
+  int tid;
+  int window;
+  long long start, end;
+} glutTraceEvent;
+
+/* single producer (the owning thread), single consumer (the trace writer) */
+#define TRACE_BUFFER_SIZE 4096
+
+typedef struct glutTraceBuffer {
+  struct glutTraceBuffer *next;
+  atomic_int used;
+  atomic_uint head, tail;
+  glutTraceEvent events[TRACE_BUFFER_SIZE];
+} glutTraceBuffer;
+
+#define EVENTS_MAX 64
+
+/* backends without an event fd are polled, in milliseconds */
+#define EVENTS_POLL_INTERVAL 10
+
 static void *backend_handle = NULL;
 
-static int t0 = 0;
+static atomic_llong t0 = 0;
 
-static int glut_dpy = 0, glut_win = 0, glut_err = 0, glut_loop = 0;
+static int glut_dpy = 0;
+static char glut_device[64];
+static __thread int glut_win = 0, glut_err = 0;
+static atomic_int glut_loop = 0;
 static glutList glut_win_list = { &glut_win_list, &glut_win_list };
+/* whether glut_win_list is not empty, readable without glut_mutex from a signal handler */
+static atomic_int glut_win_exist = 0;
+static unsigned int glut_win_destroyed = 0;
+static glutWindowSlot *glut_win_slots = NULL;
+static int glut_win_slots_count = 0, glut_win_slots_size = 0, glut_win_slots_free = -1;
+static glutWindowContext **glut_win_hash = NULL;
+static int glut_win_hash_count = 0, glut_win_hash_size = 0;
+static glutList glut_motion_list = { &glut_motion_list, &glut_motion_list };
+static atomic_int glut_redisplay = 0;
+
+static long long glut_frame_period = 0, glut_frame_deadline = 0;
+static unsigned int glut_frames_skipped = 0;
+static glutSamples glut_dispatch_samples;
+
+static glutTimer *glut_timers = NULL;
+static int glut_timers_count = 0, glut_timers_size = 0;
+static unsigned int glut_timers_seq = 0;
+
+/* render threads, enabled with GLUT_THREADS */
+static int glut_threads = 0, glut_threads_running = 0;
+/* created by the first main loop and kept open, so that a signal handler never writes to a closed descriptor */
+static atomic_int glut_wakeup = -1;
+static pthread_t glut_main_thread;
+static glutList glut_zombie_list = { &glut_zombie_list, &glut_zombie_list };
+
+/* tracing, enabled with GLUT_TRACE */
+static atomic_int glut_trace = 0;
+static long long glut_trace_t0 = 0;
+static FILE *glut_trace_file = NULL;
+static pthread_t glut_trace_thread;
+static atomic_int glut_trace_stop = 0;
+static atomic_uint glut_trace_dropped = 0;
+static _Atomic(glutTraceBuffer *) glut_trace_buffers = NULL;
+static __thread glutTraceBuffer *glut_trace_buffer = NULL;
+static pthread_key_t glut_trace_key;
+static pthread_once_t glut_trace_once = PTHREAD_ONCE_INIT;
+static int glut_trace_atexit = 0;
+
+/* guards the window registry and the timer heap, never held while a callback runs */
+static pthread_mutex_t glut_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define GLUT_LOCK() pthread_mutex_lock(&glut_mutex)
+#define GLUT_UNLOCK() pthread_mutex_unlock(&glut_mutex)
+
+#define LOOP_RUNNING() (glut_loop && glut_win_list.next != &glut_win_list)
 
 #define DISPLAY_CHECK() \
   if (!glut_dpy) { \
@@ -77,25 +213,53 @@ static glutList glut_win_list = { &glut_win_list, &glut_win_list };
   }
 
 #define WINDOW_CHECK() \
-  if (!glut_win) { \
+  if (!window_current()) { \
     printf("%s: window is NULL\n", __FUNCTION__); \
     glut_err = GLUT_BAD_WINDOW; \
   }
 
+/* window id: generation in the upper bits, slot index + 1 in the lower bits */
+#define WINDOW_SLOT_BITS 16
+#define WINDOW_SLOT_MASK ((1 << WINDOW_SLOT_BITS) - 1)
+#define WINDOW_GENERATION_MASK 0x7fff
+
+/* open addressing with linear probing, table size is a power of two */
+#define WINDOW_HASH(native_win, size) ((((unsigned int)(native_win) * 2654435769U) >> 16) & ((size) - 1))
+
 #define WINDOW_CONTEXT_GET(window) \
-  glutWindowContext *glut_win_ctx = NULL; \
-  glutList *glut_win_entry = NULL; \
-  for (glut_win_entry = glut_win_list.next; glut_win_entry != &glut_win_list; glut_win_entry = glut_win_entry->next) { \
-    glut_win_ctx = (glutWindowContext *)glut_win_entry; \
-    if (glut_win_ctx->win == window) { \
-      break; \
-    } \
+  glutWindowContext *glut_win_ctx = window_slot_get(window);
+
+/* lock and get the current window, another thread may have destroyed it since WINDOW_CHECK */
+#define WINDOW_CONTEXT_LOCK(ret) \
+  GLUT_LOCK(); \
+  WINDOW_CONTEXT_GET(glut_win); \
+  if (!glut_win_ctx) { \
+    GLUT_UNLOCK(); \
+    printf("%s: window is NULL\n", __FUNCTION__); \
+    glut_err = GLUT_BAD_WINDOW; \
+    return ret; \
   }
 
+/* record a span around a callback or a backend call when tracing */
+#define TRACE(name, window, ...) \
+  do { \
+    if (glut_trace) { \
+      int trace_window = window; \
+      long long trace_start = monotonic_time(); \
+      __VA_ARGS__; \
+      trace_event(name, trace_window, trace_start); \
+    } \
+    else { \
+      __VA_ARGS__; \
+    } \
+  } while (0)
+
 #define WINDOW_SET() \
-  if (glut_win != glut_win_ctx->win) { \
-    glut_win = glut_win_ctx->win; \
-    SetWindowProc(glut_dpy, glut_win, 1); \
+  if (glut_win != glut_win_ctx->id) { \
+    glut_win = glut_win_ctx->id; \
+    if (!glut_win_ctx->thread_started) { \
+      TRACE("SetWindowProc", glut_win, SetWindowProc(glut_dpy, glut_win_ctx->win, 1)); \
+    } \
   }
 
 static int (*InitProc)() = NULL;
@@ -110,330 +274,1276 @@ static struct attributes *(*GetDisplayAttribsProc)(int) = NULL;
 static struct attributes *(*GetWindowAttribsProc)(int) = NULL;
 static void (*DestroyWindowProc)(int, int) = NULL;
 static void (*FiniProc)() = NULL;
-static int (*GetEventProc)(int, int *, int *, int *, int *) = NULL;
+static int (*GetEventsProc)(int, struct event *, int) = NULL;
+static int (*GetEventFdProc)(int) = NULL;
+static void (*InitDeviceProc)(const char *) = NULL;
 
-static void (*IdleCb)() = NULL;
+static void (*_Atomic IdleCb)() = NULL;
 
-int glutGetError()
+static long long monotonic_time()
 {
-  return glut_err;
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
-void glutInit(int *argc, char **argv)
-{
-  char backend_path[PATH_MAX];
+#define TIMER_BEFORE(a, b) ((a)->deadline < (b)->deadline || ((a)->deadline == (b)->deadline && (int)((a)->seq - (b)->seq) < 0))
 
-  glut_err = 0;
+static void timer_heap_push(glutTimer *timer)
+{
+  int i = glut_timers_count++, parent = 0;
 
-  if (glut_dpy) {
-    printf("display already initialized\n");
-    glut_err = GLUT_DISPLAY_EXIST;
-    return;
+  while (i > 0) {
+    parent = (i - 1) / 2;
+    if (!TIMER_BEFORE(timer, &glut_timers[parent])) {
+      break;
+    }
+    glut_timers[i] = glut_timers[parent];
+    i = parent;
   }
 
-  if (!getenv("GLUT_BACKEND")) {
-    DIR *dir;
-    struct dirent *backend;
+  glut_timers[i] = *timer;
+}
 
-    dir = opendir(BACKENDSDIR);
-    if (!dir) {
-      glut_err = GLUT_BAD_BACKEND;
-      goto out;
-    }
+static void timer_heap_pop(glutTimer *timer)
+{
+  int i = 0, child = 0;
+  glutTimer *last = &glut_timers[--glut_timers_count];
 
-    while ((backend = readdir(dir))) {
-      if (backend->d_type == DT_REG && strstr(backend->d_name, ".so")) {
-        sprintf(backend_path, "%s/%s", BACKENDSDIR, backend->d_name);
-        break;
-      }
+  *timer = glut_timers[0];
+
+  while ((child = 2 * i + 1) < glut_timers_count) {
+    if (child + 1 < glut_timers_count && TIMER_BEFORE(&glut_timers[child + 1], &glut_timers[child])) {
+      child++;
     }
+    if (!TIMER_BEFORE(&glut_timers[child], last)) {
+      break;
+    }
+    glut_timers[i] = glut_timers[child];
+    i = child;
+  }
 
-    closedir(dir);
+  glut_timers[i] = *last;
+}
+
+static void samples_add(glutSamples *samples, int value)
+{
+  if (samples->count == SAMPLES_SIZE) {
+    samples->sum -= samples->value[samples->index];
   }
   else {
-    sprintf(backend_path, "%s/%s_plugin.so", BACKENDSDIR, getenv("GLUT_BACKEND"));
+    samples->count++;
   }
 
-  backend_handle = dlopen(backend_path, RTLD_LAZY);
-  if (!backend_handle) {
-    printf("%s backend not found\n", getenv("GLUT_BACKEND"));
-    glut_err = GLUT_BAD_BACKEND;
-    goto out;
-  }
+  samples->value[samples->index] = value;
+  samples->sum += value;
+  samples->index = (samples->index + 1) % SAMPLES_SIZE;
+}
 
-  #define DLSYM(sym) sym##Proc = dlsym(backend_handle, #sym); \
-  if (!sym##Proc) { \
-    printf("%s not found\n", #sym); \
-    glut_err = GLUT_BAD_BACKEND; \
-    goto out; \
-  }
+static int samples_avg(glutSamples *samples)
+{
+  return samples->count ? samples->sum / samples->count : 0;
+}
 
-  DLSYM(Init);
-  DLSYM(InitWindowPosition);
-  DLSYM(InitWindowSize);
-  DLSYM(InitDisplayMode);
-  DLSYM(InitContextProfile);
-  DLSYM(CreateWindow);
-  DLSYM(SetWindow);
-  DLSYM(SwapBuffers);
-  DLSYM(GetDisplayAttribs);
-  DLSYM(GetWindowAttribs);
-  DLSYM(DestroyWindow);
-  DLSYM(Fini);
-  DLSYM(GetEvent);
+static int samples_min(glutSamples *samples)
+{
+  int i = 0, min = 0;
 
-  glut_dpy = InitProc();
-  if (!glut_dpy) {
-    glut_err = GLUT_BAD_DISPLAY;
-    goto out;
+  for (i = 0; i < samples->count; i++) {
+    if (!i || samples->value[i] < min) {
+      min = samples->value[i];
+    }
   }
 
-  return;
-
-out:
-  if (backend_handle) {
-    dlclose(backend_handle);
-    backend_handle = NULL;
-  }
+  return min;
 }
 
-void glutInitWindowPosition(int posx, int posy)
+static int histogram_bucket(int us)
 {
-  glut_err = 0;
+  int e = 0, bucket = 0;
 
-  DISPLAY_CHECK();
-  if (glut_err) {
-    return;
+  if (us < 16) {
+    return us < 0 ? 0 : us;
   }
 
-  InitWindowPositionProc(glut_dpy, posx, posy);
+  e = 31 - __builtin_clz(us);
+  bucket = (e - 3) * 16 + ((us >> (e - 4)) & 15);
+
+  return bucket < HISTOGRAM_SIZE ? bucket : HISTOGRAM_SIZE - 1;
 }
 
-void glutInitWindowSize(int width, int height)
+/* lower bound of the bucket range, the upper bound is the one of the next bucket */
+static int histogram_bound(int bucket)
 {
-  glut_err = 0;
-
-  DISPLAY_CHECK();
-  if (glut_err) {
-    return;
+  if (bucket < 16) {
+    return bucket;
   }
 
-  InitWindowSizeProc(glut_dpy, width, height);
+  return (16 + bucket % 16) << (bucket / 16 - 1);
 }
 
-void glutInitDisplayMode(unsigned int mode)
+/* middle of the bucket range */
+static int histogram_value(int bucket)
 {
-  int double_buffer = 0, depth_size = 0;
+  return (histogram_bound(bucket) + histogram_bound(bucket + 1)) / 2;
+}
 
-  glut_err = 0;
+static int histogram_percentile(unsigned int *histogram, unsigned int count, int percent)
+{
+  int bucket = 0;
+  unsigned int rank = 0, n = 0;
 
-  DISPLAY_CHECK();
-  if (glut_err) {
-    return;
+  if (!count) {
+    return 0;
   }
 
-  if (mode & GLUT_DOUBLE) {
-    double_buffer = 1;
-  }
+  rank = (count * (long long)percent + 99) / 100;
 
-  if (mode & GLUT_DEPTH) {
-    if (getenv("DEPTH_SIZE")) {
-      depth_size = atoi(getenv("DEPTH_SIZE"));
-    }
-    else {
-      depth_size = 1;
+  for (bucket = 0; bucket < HISTOGRAM_SIZE; bucket++) {
+    n += histogram[bucket];
+    if (n >= rank) {
+      break;
     }
   }
 
-  InitDisplayModeProc(glut_dpy, double_buffer, depth_size);
+  return histogram_value(bucket);
 }
 
-void glutInitContextProfile(int profile)
+/* the histogram mirrors the frame samples, so percentiles cover the same frames as min and avg */
+static int frame_percentile(glutWindowContext *glut_win_ctx, int percent)
 {
-  glut_err = 0;
+  int value = histogram_percentile(glut_win_ctx->frame_histogram, glut_win_ctx->frame_samples.count, percent);
+  int min = samples_min(&glut_win_ctx->frame_samples);
 
-  DISPLAY_CHECK();
-  if (glut_err) {
-    return;
-  }
+  return value < min ? min : value;
+}
 
-  InitContextProfileProc(glut_dpy, profile == GLUT_ES_PROFILE ? 1 : 0);
+static void input_pending(glutWindowContext *glut_win_ctx, long long time)
+{
+  GLUT_LOCK();
+  if (glut_win_ctx->input_count < INPUT_PENDING_MAX) {
+    glut_win_ctx->input_time[glut_win_ctx->input_count++] = time;
+  }
+  GLUT_UNLOCK();
 }
 
-int glutCreateWindow(const char *title)
+/* the input delivered before a swap is presented by it */
+static void latency_record(glutWindowContext *glut_win_ctx, long long end)
 {
-  glut_err = 0;
-  glutWindowContext *glut_win_ctx = NULL;
-  glutList *glut_win_entry = NULL;
+  int i = 0, latency = 0;
 
-  DISPLAY_CHECK();
-  if (glut_err) {
-    return 0;
+  for (i = 0; i < glut_win_ctx->input_count; i++) {
+    latency = (end - glut_win_ctx->input_time[i]) / 1000;
+    glut_win_ctx->latency_histogram[histogram_bucket(latency)]++;
+    glut_win_ctx->latency_count++;
+    glut_win_ctx->latency_sum += latency;
   }
 
-  glut_win_ctx = calloc(1, sizeof(glutWindowContext));
-  FIU_CHECK(glut_win_ctx);
-  if (!glut_win_ctx) {
-    printf("glut_win_ctx calloc error\n");
-    glut_err = GLUT_BAD_ALLOC;
-    return 0;
-  }
+  glut_win_ctx->input_count = 0;
+}
 
-  glut_win_ctx->win = CreateWindowProc(glut_dpy);
-  if (!glut_win_ctx->win) {
-    glut_err = GLUT_BAD_WINDOW;
-    goto out;
-  }
+static void frame_record(glutWindowContext *glut_win_ctx, long long start, long long end)
+{
+  glutSamples *samples = &glut_win_ctx->frame_samples;
+  int frame = 0;
 
-  glut_win_entry = &glut_win_ctx->entry;
-  glut_win_entry->next = glut_win_list.next;
-  glut_win_entry->prev = &glut_win_list;
-  glut_win_list.next->prev = glut_win_entry;
-  glut_win_list.next = glut_win_entry;
+  samples_add(&glut_win_ctx->swap_samples, (end - start) / 1000);
 
-  glut_win = glut_win_ctx->win;
+  if (glut_win_ctx->last_swap) {
+    frame = (end - glut_win_ctx->last_swap) / 1000;
+    if (samples->count == SAMPLES_SIZE) {
+      glut_win_ctx->frame_histogram[histogram_bucket(samples->value[samples->index])]--;
+    }
+    samples_add(samples, frame);
+    glut_win_ctx->frame_histogram[histogram_bucket(frame)]++;
+  }
 
-  SetWindowProc(glut_dpy, glut_win, 1);
+  glut_win_ctx->last_swap = end;
+}
 
-  return glut_win;
+static void trace_thread_exit(void *arg)
+{
+  glutTraceBuffer *buffer = arg;
 
-out:
-  free(glut_win_ctx);
-  return 0;
+  buffer->used = 0;
 }
 
-void glutSetWindow(int window)
+static void trace_key_create()
 {
-  glut_err = 0;
+  pthread_key_create(&glut_trace_key, trace_thread_exit);
+}
 
-  WINDOW_CHECK();
-  if (glut_err) {
-    return;
+/* buffers are registered on a lock-free list, they are never freed but reused once their thread exits */
+static glutTraceBuffer *trace_buffer_get()
+{
+  glutTraceBuffer *buffer = NULL;
+  int unused = 0;
+
+  if (glut_trace_buffer) {
+    return glut_trace_buffer;
   }
 
-  WINDOW_CONTEXT_GET(window);
+  for (buffer = glut_trace_buffers; buffer; buffer = buffer->next) {
+    unused = 0;
+    if (atomic_compare_exchange_strong(&buffer->used, &unused, 1)) {
+      break;
+    }
+  }
 
-  if (glut_win_entry == &glut_win_list) {
-    printf("Invalid window\n");
-    glut_err = GLUT_BAD_VALUE;
-    return;
+  if (!buffer) {
+    buffer = calloc(1, sizeof(glutTraceBuffer));
+    if (!buffer) {
+      return NULL;
+    }
+    buffer->used = 1;
+    buffer->next = glut_trace_buffers;
+    while (!atomic_compare_exchange_weak(&glut_trace_buffers, &buffer->next, buffer));
   }
 
-  WINDOW_SET();
+  pthread_once(&glut_trace_once, trace_key_create);
+  pthread_setspecific(glut_trace_key, buffer);
+
+  glut_trace_buffer = buffer;
+
+  return buffer;
 }
 
-void glutSetWindowData(void *data)
+static void trace_event(const char *name, int window, long long start)
 {
-  glut_err = 0;
+  glutTraceBuffer *buffer = trace_buffer_get();
+  unsigned int head = 0;
+  glutTraceEvent *event = NULL;
 
-  WINDOW_CHECK();
-  if (glut_err) {
+  if (!buffer) {
+    return;
+  }
+
+  head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&buffer->tail, memory_order_acquire) == TRACE_BUFFER_SIZE) {
+    glut_trace_dropped++;
     return;
   }
 
-  WINDOW_CONTEXT_GET(glut_win);
+  event = &buffer->events[head % TRACE_BUFFER_SIZE];
+  event->name = name;
+  event->tid = syscall(SYS_gettid);
+  event->window = window;
+  event->start = start;
+  event->end = monotonic_time();
 
-  glut_win_ctx->data = data;
+  atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
 }
 
-void *glutGetWindowData()
+static void trace_flush()
 {
-  glut_err = 0;
-
-  WINDOW_CHECK();
-  if (glut_err) {
-    return NULL;
+  glutTraceBuffer *buffer = NULL;
+  glutTraceEvent *event = NULL;
+  unsigned int head = 0, tail = 0;
+
+  for (buffer = glut_trace_buffers; buffer; buffer = buffer->next) {
+    head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+    for (tail = buffer->tail; tail != head; tail++) {
+      event = &buffer->events[tail % TRACE_BUFFER_SIZE];
+      fprintf(glut_trace_file, ",\n{\"name\":\"%s\",\"cat\":\"glut\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"window\":%d}}", event->name, getpid(), event->tid, (event->start - glut_trace_t0) / 1000.0, (event->end - event->start) / 1000.0, event->window);
+    }
+    atomic_store_explicit(&buffer->tail, head, memory_order_release);
   }
 
-  WINDOW_CONTEXT_GET(glut_win);
-
-  return glut_win_ctx->data;
+  fflush(glut_trace_file);
 }
 
-void glutReshapeFunc(void (*func)(int, int))
+static void *trace_writer(void *arg)
 {
-  glut_err = 0;
+  struct timespec ts = { 0, 50000000 };
 
-  WINDOW_CHECK();
-  if (glut_err) {
-    return;
+  while (!glut_trace_stop) {
+    nanosleep(&ts, NULL);
+    trace_flush();
   }
 
-  WINDOW_CONTEXT_GET(glut_win);
+  trace_flush();
 
-  glut_win_ctx->reshape_cb = func;
+  return NULL;
 }
 
-void glutDisplayFunc(void (*func)())
+static void trace_stop()
 {
-  glut_err = 0;
-
-  WINDOW_CHECK();
-  if (glut_err) {
+  if (!glut_trace) {
     return;
   }
 
-  WINDOW_CONTEXT_GET(glut_win);
+  glut_trace = 0;
+  glut_trace_stop = 1;
+  pthread_join(glut_trace_thread, NULL);
 
-  glut_win_ctx->display_cb = func;
+  fprintf(glut_trace_file, "\n]\n");
+  fclose(glut_trace_file);
+  glut_trace_file = NULL;
+
+  if (glut_trace_dropped) {
+    printf("%u trace events dropped\n", (unsigned int)glut_trace_dropped);
+  }
 }
 
-void glutIdleFunc(void (*func)())
+static void trace_start(const char *path)
 {
-  glut_err = 0;
+  glutTraceBuffer *buffer = NULL;
 
-  WINDOW_CHECK();
-  if (glut_err) {
+  glut_trace_file = fopen(path, "w");
+  if (!glut_trace_file) {
+    printf("%s: cannot open trace file\n", path);
     return;
   }
 
-  IdleCb = func;
-}
+  for (buffer = glut_trace_buffers; buffer; buffer = buffer->next) {
+    buffer->tail = buffer->head;
+  }
 
-void glutKeyboardFunc(void (*func)(unsigned char, int, int))
-{
-  glut_err = 0;
+  glut_trace_t0 = monotonic_time();
+  fprintf(glut_trace_file, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"glut\"}}", getpid());
 
-  WINDOW_CHECK();
-  if (glut_err) {
+  glut_trace_stop = 0;
+  glut_trace_dropped = 0;
+
+  if (pthread_create(&glut_trace_thread, NULL, trace_writer, NULL)) {
+    printf("pthread_create error\n");
+    fclose(glut_trace_file);
+    glut_trace_file = NULL;
     return;
   }
 
-  WINDOW_CONTEXT_GET(glut_win);
+  glut_trace = 1;
 
-  glut_win_ctx->keyboard_cb = func;
+  /* the trace is also completed when the application exits without glutExit */
+  if (!glut_trace_atexit) {
+    glut_trace_atexit = 1;
+    atexit(trace_stop);
+  }
 }
 
-void glutSpecialFunc(void (*func)(int, int, int))
+
+static glutWindowContext *window_slot_get(int window)
 {
-  glut_err = 0;
+  int i = (window & WINDOW_SLOT_MASK) - 1;
 
-  WINDOW_CHECK();
-  if (glut_err) {
-    return;
+  if (i < 0 || i >= glut_win_slots_count || glut_win_slots[i].generation != window >> WINDOW_SLOT_BITS) {
+    return NULL;
   }
 
-  WINDOW_CONTEXT_GET(glut_win);
-
-  glut_win_ctx->special_cb = func;
+  return glut_win_slots[i].ctx;
 }
 
-void glutPassiveMotionFunc(void (*func)(int, int))
+/* the current window of a thread may have been destroyed by another thread */
+static int window_current()
 {
-  glut_err = 0;
+  GLUT_LOCK();
 
-  WINDOW_CHECK();
-  if (glut_err) {
-    return;
+  if (!window_slot_get(glut_win)) {
+    glut_win = glut_win_list.next != &glut_win_list ? ((glutWindowContext *)glut_win_list.next)->id : 0;
   }
 
-  WINDOW_CONTEXT_GET(glut_win);
+  GLUT_UNLOCK();
 
-  glut_win_ctx->passive_motion_cb = func;
+  return glut_win;
+}
+
+static int window_slot_alloc(glutWindowContext *glut_win_ctx)
+{
+  int i = 0;
+  glutWindowSlot *slots = NULL;
+
+  if (glut_win_slots_free != -1) {
+    i = glut_win_slots_free;
+    glut_win_slots_free = glut_win_slots[i].next_free;
+  }
+  else {
+    if (glut_win_slots_count == WINDOW_SLOT_MASK) {
+      printf("too many windows\n");
+      return 0;
+    }
+    if (glut_win_slots_count == glut_win_slots_size) {
+      slots = FIU_FAIL() ? NULL : realloc(glut_win_slots, (glut_win_slots_size ? 2 * glut_win_slots_size : 16) * sizeof(glutWindowSlot));
+      if (!slots) {
+        printf("glut_win_slots realloc error\n");
+        return 0;
+      }
+      glut_win_slots = slots;
+      glut_win_slots_size = glut_win_slots_size ? 2 * glut_win_slots_size : 16;
+    }
+    i = glut_win_slots_count++;
+    glut_win_slots[i].generation = 0;
+  }
+
+  glut_win_slots[i].ctx = glut_win_ctx;
+  glut_win_slots[i].next_free = -1;
+
+  return (glut_win_slots[i].generation << WINDOW_SLOT_BITS) | (i + 1);
+}
+
+static void window_slot_free(int window)
+{
+  int i = (window & WINDOW_SLOT_MASK) - 1;
+
+  glut_win_slots[i].ctx = NULL;
+  glut_win_slots[i].generation = (glut_win_slots[i].generation + 1) & WINDOW_GENERATION_MASK;
+  glut_win_slots[i].next_free = glut_win_slots_free;
+  glut_win_slots_free = i;
+}
+
+static int window_hash_reserve()
+{
+  int i = 0, j = 0, size = 0;
+  glutWindowContext **hash = NULL;
+
+  if (2 * (glut_win_hash_count + 1) <= glut_win_hash_size) {
+    return 0;
+  }
+
+  size = glut_win_hash_size ? 2 * glut_win_hash_size : 32;
+  hash = calloc(size, sizeof(glutWindowContext *));
+  FIU_CHECK(hash);
+  if (!hash) {
+    printf("glut_win_hash calloc error\n");
+    return -1;
+  }
+
+  for (i = 0; i < glut_win_hash_size; i++) {
+    if (glut_win_hash[i]) {
+      j = WINDOW_HASH(glut_win_hash[i]->native_win, size);
+      while (hash[j]) {
+        j = (j + 1) & (size - 1);
+      }
+      hash[j] = glut_win_hash[i];
+    }
+  }
+
+  free(glut_win_hash);
+  glut_win_hash = hash;
+  glut_win_hash_size = size;
+
+  return 0;
+}
+
+static void window_hash_insert(glutWindowContext *glut_win_ctx)
+{
+  int i = WINDOW_HASH(glut_win_ctx->native_win, glut_win_hash_size);
+
+  while (glut_win_hash[i]) {
+    i = (i + 1) & (glut_win_hash_size - 1);
+  }
+
+  glut_win_hash[i] = glut_win_ctx;
+  glut_win_hash_count++;
+}
+
+static glutWindowContext *window_hash_get(int native_win)
+{
+  int i = 0;
+
+  if (!glut_win_hash_count) {
+    return NULL;
+  }
+
+  for (i = WINDOW_HASH(native_win, glut_win_hash_size); glut_win_hash[i]; i = (i + 1) & (glut_win_hash_size - 1)) {
+    if (glut_win_hash[i]->native_win == native_win) {
+      return glut_win_hash[i];
+    }
+  }
+
+  return NULL;
+}
+
+static void window_hash_remove(glutWindowContext *glut_win_ctx)
+{
+  int i = WINDOW_HASH(glut_win_ctx->native_win, glut_win_hash_size), j = 0, k = 0;
+
+  while (glut_win_hash[i] != glut_win_ctx) {
+    i = (i + 1) & (glut_win_hash_size - 1);
+  }
+
+  /* shift back the following entries of the cluster that would become unreachable */
+  for (j = (i + 1) & (glut_win_hash_size - 1); glut_win_hash[j]; j = (j + 1) & (glut_win_hash_size - 1)) {
+    k = WINDOW_HASH(glut_win_hash[j]->native_win, glut_win_hash_size);
+    if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+      glut_win_hash[i] = glut_win_hash[j];
+      i = j;
+    }
+  }
+
+  glut_win_hash[i] = NULL;
+  glut_win_hash_count--;
+}
+
+static void motion_history_add(glutWindowContext *glut_win_ctx, int x, int y)
+{
+  int size = 0, *history_x = NULL, *history_y = NULL;
+
+  if (glut_win_ctx->motion_history_count == glut_win_ctx->motion_history_size) {
+    size = glut_win_ctx->motion_history_size ? 2 * glut_win_ctx->motion_history_size : 64;
+    history_x = realloc(glut_win_ctx->motion_history_x, size * sizeof(int));
+    if (history_x) {
+      glut_win_ctx->motion_history_x = history_x;
+      history_y = realloc(glut_win_ctx->motion_history_y, size * sizeof(int));
+    }
+    if (!history_x || !history_y) {
+      printf("motion history realloc error\n");
+      return;
+    }
+    glut_win_ctx->motion_history_y = history_y;
+    glut_win_ctx->motion_history_size = size;
+  }
+
+  glut_win_ctx->motion_history_x[glut_win_ctx->motion_history_count] = x;
+  glut_win_ctx->motion_history_y[glut_win_ctx->motion_history_count] = y;
+  glut_win_ctx->motion_history_count++;
+}
+
+static void motion_record(glutWindowContext *glut_win_ctx, int x, int y, long long time)
+{
+  if (!glut_win_ctx->motion_pending) {
+    glut_win_ctx->motion_time = time;
+  }
+
+  glut_win_ctx->motion_pending = 1;
+  glut_win_ctx->motion_x = x;
+  glut_win_ctx->motion_y = y;
+
+  if (glut_win_ctx->passive_motion_history_cb) {
+    motion_history_add(glut_win_ctx, x, y);
+  }
+}
+
+static void motion_deliver(glutWindowContext *glut_win_ctx)
+{
+  int id = glut_win_ctx->id, count = glut_win_ctx->motion_history_count, alive = 0;
+  void (*passive_motion_history_cb)(int, int *, int *) = glut_win_ctx->passive_motion_history_cb;
+  void (*passive_motion_cb)(int, int) = NULL;
+
+  glut_win_ctx->motion_pending = 0;
+  glut_win_ctx->motion_history_count = 0;
+
+  input_pending(glut_win_ctx, glut_win_ctx->motion_time);
+
+  if (passive_motion_history_cb && count) {
+    WINDOW_SET();
+    TRACE("passive_motion_history_cb", glut_win_ctx->id, passive_motion_history_cb(count, glut_win_ctx->motion_history_x, glut_win_ctx->motion_history_y));
+    GLUT_LOCK();
+    alive = window_slot_get(id) == glut_win_ctx;
+    GLUT_UNLOCK();
+    if (!alive || !glut_loop) {
+      return;
+    }
+  }
+
+  passive_motion_cb = glut_win_ctx->passive_motion_cb;
+  if (passive_motion_cb) {
+    WINDOW_SET();
+    TRACE("passive_motion_cb", glut_win_ctx->id, passive_motion_cb(glut_win_ctx->motion_x, glut_win_ctx->motion_y));
+  }
+}
+
+static void window_wakeup()
+{
+  if (glut_wakeup != -1 && !pthread_equal(pthread_self(), glut_main_thread)) {
+    eventfd_write(glut_wakeup, 1);
+  }
+}
+
+/* queue an input event, or a redisplay if event is NULL, for the render thread of the window */
+static void window_thread_post(glutWindowContext *glut_win_ctx, struct event *event)
+{
+  int size = 0;
+  struct event *events = NULL;
+
+  pthread_mutex_lock(&glut_win_ctx->thread_mutex);
+
+  if (!event) {
+    glut_win_ctx->thread_redisplay = 1;
+  }
+  else {
+    if (glut_win_ctx->thread_events_count == glut_win_ctx->thread_events_size) {
+      size = glut_win_ctx->thread_events_size ? 2 * glut_win_ctx->thread_events_size : EVENTS_MAX;
+      events = realloc(glut_win_ctx->thread_events, size * sizeof(struct event));
+      if (events) {
+        glut_win_ctx->thread_events = events;
+        glut_win_ctx->thread_events_size = size;
+      }
+    }
+    if (glut_win_ctx->thread_events_count < glut_win_ctx->thread_events_size) {
+      glut_win_ctx->thread_events[glut_win_ctx->thread_events_count++] = *event;
+    }
+    else {
+      printf("thread_events realloc error\n");
+    }
+  }
+
+  pthread_cond_signal(&glut_win_ctx->thread_cond);
+
+  pthread_mutex_unlock(&glut_win_ctx->thread_mutex);
+}
+
+static void *window_thread(void *arg)
+{
+  glutWindowContext *glut_win_ctx = arg;
+  struct event *events = NULL, *swap = NULL;
+  struct attributes *attribs = NULL;
+  int i = 0, count = 0, size = 0, redisplay = 0;
+  long long start = 0;
+  void (*reshape_cb)() = glut_win_ctx->reshape_cb;
+  void (*display_cb)() = NULL;
+  void (*keyboard_cb)(unsigned char, int, int) = NULL;
+  void (*special_cb)(int, int, int) = NULL;
+
+  glut_win = glut_win_ctx->id;
+  TRACE("SetWindowProc", glut_win_ctx->id, SetWindowProc(glut_dpy, glut_win_ctx->win, 1));
+
+  if (reshape_cb) {
+    attribs = GetWindowAttribsProc(glut_win_ctx->win);
+    TRACE("reshape_cb", glut_win_ctx->id, reshape_cb(attribs->win_width, attribs->win_height));
+  }
+
+  pthread_mutex_lock(&glut_win_ctx->thread_mutex);
+
+  while (!glut_win_ctx->thread_stop) {
+    if (!glut_win_ctx->thread_events_count && !glut_win_ctx->thread_redisplay) {
+      pthread_cond_wait(&glut_win_ctx->thread_cond, &glut_win_ctx->thread_mutex);
+      continue;
+    }
+
+    /* take the queued events, the emptied buffer is given back for the next ones */
+    swap = glut_win_ctx->thread_events;
+    glut_win_ctx->thread_events = events;
+    events = swap;
+    i = glut_win_ctx->thread_events_size;
+    glut_win_ctx->thread_events_size = size;
+    size = i;
+    count = glut_win_ctx->thread_events_count;
+    glut_win_ctx->thread_events_count = 0;
+    redisplay = glut_win_ctx->thread_redisplay;
+    glut_win_ctx->thread_redisplay = 0;
+
+    pthread_mutex_unlock(&glut_win_ctx->thread_mutex);
+
+    for (i = 0; i < count && !glut_win_ctx->thread_stop; i++) {
+      if (events[i].type == EVENT_PASSIVEMOTION) {
+        if (glut_win_ctx->passive_motion_cb || glut_win_ctx->passive_motion_history_cb) {
+          motion_record(glut_win_ctx, events[i].x, events[i].y, events[i].time);
+        }
+        continue;
+      }
+
+      if (glut_win_ctx->motion_pending) {
+        motion_deliver(glut_win_ctx);
+        if (glut_win_ctx->thread_stop) {
+          break;
+        }
+      }
+
+      keyboard_cb = events[i].type == EVENT_KEYBOARD ? glut_win_ctx->keyboard_cb : NULL;
+      special_cb = events[i].type == EVENT_SPECIAL ? glut_win_ctx->special_cb : NULL;
+
+      if (keyboard_cb || special_cb) {
+        input_pending(glut_win_ctx, events[i].time);
+      }
+
+      if (keyboard_cb) {
+        TRACE("keyboard_cb", glut_win_ctx->id, keyboard_cb(events[i].key, 0, 0));
+      }
+      else if (special_cb) {
+        TRACE("special_cb", glut_win_ctx->id, special_cb(events[i].key, 0, 0));
+      }
+    }
+
+    if (glut_win_ctx->motion_pending && !glut_win_ctx->thread_stop) {
+      motion_deliver(glut_win_ctx);
+    }
+
+    display_cb = redisplay ? glut_win_ctx->display_cb : NULL;
+    if (display_cb && !glut_win_ctx->thread_stop) {
+      start = monotonic_time();
+      TRACE("display_cb", glut_win_ctx->id, display_cb());
+      GLUT_LOCK();
+      samples_add(&glut_win_ctx->display_samples, (monotonic_time() - start) / 1000);
+      GLUT_UNLOCK();
+    }
+
+    pthread_mutex_lock(&glut_win_ctx->thread_mutex);
+  }
+
+  pthread_mutex_unlock(&glut_win_ctx->thread_mutex);
+
+  TRACE("SetWindowProc", glut_win_ctx->id, SetWindowProc(glut_dpy, glut_win_ctx->win, 0));
+
+  free(events);
+
+  return NULL;
+}
+
+static void window_thread_start(glutWindowContext *glut_win_ctx)
+{
+  glut_win_ctx->thread_started = 1;
+
+  if (pthread_create(&glut_win_ctx->thread, NULL, window_thread, glut_win_ctx)) {
+    printf("pthread_create error\n");
+    glut_win_ctx->thread_started = 0;
+  }
+}
+
+static void window_context_free(glutWindowContext *glut_win_ctx)
+{
+  if (glut_threads) {
+    pthread_mutex_destroy(&glut_win_ctx->thread_mutex);
+    pthread_cond_destroy(&glut_win_ctx->thread_cond);
+  }
+
+  free(glut_win_ctx->thread_events);
+  free(glut_win_ctx->motion_history_x);
+  free(glut_win_ctx->motion_history_y);
+  free(glut_win_ctx);
+}
+
+/* destroy the windows released by other threads while the main loop runs, only called from the main thread */
+static void window_reap()
+{
+  int reaped = 0, win = 0;
+  glutWindowContext *glut_win_ctx = NULL;
+
+  while (1) {
+    GLUT_LOCK();
+    if (glut_zombie_list.next == &glut_zombie_list) {
+      GLUT_UNLOCK();
+      break;
+    }
+    glut_win_ctx = (glutWindowContext *)glut_zombie_list.next;
+    glut_win_ctx->entry.next->prev = glut_win_ctx->entry.prev;
+    glut_win_ctx->entry.prev->next = glut_win_ctx->entry.next;
+    GLUT_UNLOCK();
+
+    if (glut_win_ctx->thread_started) {
+      pthread_join(glut_win_ctx->thread, NULL);
+    }
+    else {
+      TRACE("SetWindowProc", glut_win_ctx->id, SetWindowProc(glut_dpy, glut_win_ctx->win, 0));
+    }
+
+    TRACE("DestroyWindowProc", glut_win_ctx->id, DestroyWindowProc(glut_dpy, glut_win_ctx->win));
+
+    window_context_free(glut_win_ctx);
+
+    reaped = 1;
+  }
+
+  if (reaped && window_current()) {
+    GLUT_LOCK();
+    glut_win_ctx = window_slot_get(glut_win);
+    win = glut_win_ctx && !glut_win_ctx->thread_started ? glut_win_ctx->win : 0;
+    GLUT_UNLOCK();
+    if (win) {
+      TRACE("SetWindowProc", glut_win, SetWindowProc(glut_dpy, win, 1));
+    }
+  }
+}
+
+/* nanoseconds since the first elapsed time query */
+static long long elapsed_time()
+{
+  long long t = monotonic_time(), start = 0;
+
+  if (atomic_compare_exchange_strong(&t0, &start, t)) {
+    return 0;
+  }
+
+  return t - start;
+}
+
+int glutGetError()
+{
+  return glut_err;
+}
+
+void glutInit(int *argc, char **argv)
+{
+  char backend_path[PATH_MAX];
+
+  glut_err = 0;
+
+  if (glut_dpy) {
+    printf("display already initialized\n");
+    glut_err = GLUT_DISPLAY_EXIST;
+    return;
+  }
+
+  if (!getenv("GLUT_BACKEND")) {
+    DIR *dir;
+    struct dirent *backend;
+
+    dir = opendir(BACKENDSDIR);
+    if (!dir) {
+      glut_err = GLUT_BAD_BACKEND;
+      goto out;
+    }
+
+    while ((backend = readdir(dir))) {
+      if (backend->d_type == DT_REG && strstr(backend->d_name, ".so")) {
+        sprintf(backend_path, "%s/%s", BACKENDSDIR, backend->d_name);
+        break;
+      }
+    }
+
+    closedir(dir);
+  }
+  else {
+    sprintf(backend_path, "%s/%s_plugin.so", BACKENDSDIR, getenv("GLUT_BACKEND"));
+  }
+
+  backend_handle = dlopen(backend_path, RTLD_LAZY);
+  if (!backend_handle) {
+    printf("%s backend not found\n", getenv("GLUT_BACKEND"));
+    glut_err = GLUT_BAD_BACKEND;
+    goto out;
+  }
+
+  #define DLSYM(sym) sym##Proc = dlsym(backend_handle, #sym); \
+  if (!sym##Proc) { \
+    printf("%s not found\n", #sym); \
+    glut_err = GLUT_BAD_BACKEND; \
+    goto out; \
+  }
+
+  DLSYM(Init);
+  DLSYM(InitWindowPosition);
+  DLSYM(InitWindowSize);
+  DLSYM(InitDisplayMode);
+  DLSYM(InitContextProfile);
+  DLSYM(CreateWindow);
+  DLSYM(SetWindow);
+  DLSYM(SwapBuffers);
+  DLSYM(GetDisplayAttribs);
+  DLSYM(GetWindowAttribs);
+  DLSYM(DestroyWindow);
+  DLSYM(Fini);
+  DLSYM(GetEvents);
+  DLSYM(GetEventFd);
+
+  /* optional, for the backends selecting a device */
+  InitDeviceProc = dlsym(backend_handle, "InitDevice");
+  if (InitDeviceProc) {
+    InitDeviceProc(glut_device[0] ? glut_device : NULL);
+  }
+  else if (glut_device[0]) {
+    printf("device %s not selectable with this backend\n", glut_device);
+  }
+
+  glut_dpy = InitProc();
+  if (!glut_dpy) {
+    glut_err = GLUT_BAD_DISPLAY;
+    goto out;
+  }
+
+  /* frames are scheduled at the display refresh rate when the backend knows it (in millihertz) */
+  if (getenv("FRAME_RATE") && atoi(getenv("FRAME_RATE")) > 0) {
+    glut_frame_period = 1000000000LL / atoi(getenv("FRAME_RATE"));
+  }
+  else if (GetDisplayAttribsProc(glut_dpy)->refresh_rate > 0) {
+    glut_frame_period = 1000000000000LL / GetDisplayAttribsProc(glut_dpy)->refresh_rate;
+  }
+
+  if (getenv("GLUT_THREADS") && atoi(getenv("GLUT_THREADS"))) {
+    glut_threads = 1;
+  }
+
+  if (getenv("GLUT_TRACE")) {
+    trace_start(getenv("GLUT_TRACE"));
+  }
+
+  return;
+
+out:
+  if (backend_handle) {
+    dlclose(backend_handle);
+    backend_handle = NULL;
+  }
+}
+
+void glutInitDevice(const char *device)
+{
+  glut_err = 0;
+
+  if (glut_dpy) {
+    printf("display already initialized\n");
+    glut_err = GLUT_DISPLAY_EXIST;
+    return;
+  }
+
+  snprintf(glut_device, sizeof(glut_device), "%s", device ? device : "");
+}
+
+void glutInitWindowPosition(int posx, int posy)
+{
+  glut_err = 0;
+
+  DISPLAY_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  InitWindowPositionProc(glut_dpy, posx, posy);
+}
+
+void glutInitWindowSize(int width, int height)
+{
+  glut_err = 0;
+
+  DISPLAY_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  InitWindowSizeProc(glut_dpy, width, height);
+}
+
+void glutInitDisplayMode(unsigned int mode)
+{
+  int double_buffer = 0, depth_size = 0;
+
+  glut_err = 0;
+
+  DISPLAY_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  if (mode & GLUT_DOUBLE) {
+    double_buffer = 1;
+  }
+
+  if (mode & GLUT_DEPTH) {
+    if (getenv("DEPTH_SIZE")) {
+      depth_size = atoi(getenv("DEPTH_SIZE"));
+    }
+    else {
+      depth_size = 1;
+    }
+  }
+
+  InitDisplayModeProc(glut_dpy, double_buffer, depth_size);
+}
+
+void glutInitContextProfile(int profile)
+{
+  glut_err = 0;
+
+  DISPLAY_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  InitContextProfileProc(glut_dpy, profile == GLUT_ES_PROFILE ? 1 : 0);
+}
+
+int glutCreateWindow(const char *title)
+{
+  glut_err = 0;
+  glutWindowContext *glut_win_ctx = NULL;
+  glutList *glut_win_entry = NULL;
+
+  DISPLAY_CHECK();
+  if (glut_err) {
+    return 0;
+  }
+
+  glut_win_ctx = calloc(1, sizeof(glutWindowContext));
+  FIU_CHECK(glut_win_ctx);
+  if (!glut_win_ctx) {
+    printf("glut_win_ctx calloc error\n");
+    glut_err = GLUT_BAD_ALLOC;
+    return 0;
+  }
+
+  if (glut_threads) {
+    pthread_mutex_init(&glut_win_ctx->thread_mutex, NULL);
+    pthread_cond_init(&glut_win_ctx->thread_cond, NULL);
+  }
+
+  GLUT_LOCK();
+
+  glut_win_ctx->id = window_slot_alloc(glut_win_ctx);
+  if (!glut_win_ctx->id) {
+    GLUT_UNLOCK();
+    glut_err = GLUT_BAD_ALLOC;
+    goto out;
+  }
+
+  if (window_hash_reserve() == -1) {
+    window_slot_free(glut_win_ctx->id);
+    GLUT_UNLOCK();
+    glut_err = GLUT_BAD_ALLOC;
+    goto out;
+  }
+
+  GLUT_UNLOCK();
+
+  TRACE("CreateWindowProc", glut_win_ctx->id, glut_win_ctx->win = CreateWindowProc(glut_dpy));
+  if (!glut_win_ctx->win) {
+    GLUT_LOCK();
+    window_slot_free(glut_win_ctx->id);
+    GLUT_UNLOCK();
+    glut_err = GLUT_BAD_WINDOW;
+    goto out;
+  }
+
+  GLUT_LOCK();
+
+  glut_win_ctx->native_win = *(int *)(long)glut_win_ctx->win;
+  window_hash_insert(glut_win_ctx);
+
+  glut_win_entry = &glut_win_ctx->entry;
+  glut_win_entry->next = glut_win_list.next;
+  glut_win_entry->prev = &glut_win_list;
+  glut_win_list.next->prev = glut_win_entry;
+  glut_win_list.next = glut_win_entry;
+  glut_win_exist = 1;
+
+  glut_win = glut_win_ctx->id;
+
+  /* while the main loop runs, the context is made current by the render thread of the window */
+  if (glut_threads_running) {
+    window_thread_start(glut_win_ctx);
+  }
+
+  GLUT_UNLOCK();
+
+  if (!glut_win_ctx->thread_started) {
+    TRACE("SetWindowProc", glut_win_ctx->id, SetWindowProc(glut_dpy, glut_win_ctx->win, 1));
+  }
+
+  return glut_win;
+
+out:
+  window_context_free(glut_win_ctx);
+  return 0;
+}
+
+void glutSetWindow(int window)
+{
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  GLUT_LOCK();
+
+  WINDOW_CONTEXT_GET(window);
+
+  if (!glut_win_ctx) {
+    GLUT_UNLOCK();
+    printf("Invalid window\n");
+    glut_err = GLUT_BAD_VALUE;
+    return;
+  }
+
+  WINDOW_SET();
+
+  GLUT_UNLOCK();
+}
+
+void glutSetWindowData(void *data)
+{
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  WINDOW_CONTEXT_LOCK();
+
+  glut_win_ctx->data = data;
+
+  GLUT_UNLOCK();
+}
+
+void *glutGetWindowData()
+{
+  void *data = NULL;
+
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return NULL;
+  }
+
+  WINDOW_CONTEXT_LOCK(NULL);
+
+  data = glut_win_ctx->data;
+
+  GLUT_UNLOCK();
+
+  return data;
+}
+
+void glutReshapeFunc(void (*func)(int, int))
+{
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  WINDOW_CONTEXT_LOCK();
+
+  glut_win_ctx->reshape_cb = func;
+
+  GLUT_UNLOCK();
+}
+
+void glutDisplayFunc(void (*func)())
+{
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  WINDOW_CONTEXT_LOCK();
+
+  glut_win_ctx->display_cb = func;
+
+  GLUT_UNLOCK();
+}
+
+void glutIdleFunc(void (*func)())
+{
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  IdleCb = func;
+}
+
+void glutTimerFunc(unsigned int msecs, void (*func)(int), int value)
+{
+  glutTimer timer, *timers = NULL;
+
+  glut_err = 0;
+
+  DISPLAY_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  if (!func) {
+    printf("Invalid timer callback\n");
+    glut_err = GLUT_BAD_VALUE;
+    return;
+  }
+
+  GLUT_LOCK();
+
+  if (glut_timers_count == glut_timers_size) {
+    timers = FIU_FAIL() ? NULL : realloc(glut_timers, (glut_timers_size ? 2 * glut_timers_size : 16) * sizeof(glutTimer));
+    if (!timers) {
+      GLUT_UNLOCK();
+      printf("glut_timers realloc error\n");
+      glut_err = GLUT_BAD_ALLOC;
+      return;
+    }
+    glut_timers = timers;
+    glut_timers_size = glut_timers_size ? 2 * glut_timers_size : 16;
+  }
+
+  timer.deadline = monotonic_time() + msecs * 1000000LL;
+  timer.seq = glut_timers_seq++;
+  timer.func = func;
+  timer.value = value;
+
+  timer_heap_push(&timer);
+
+  GLUT_UNLOCK();
+
+  window_wakeup();
+}
+
+void glutKeyboardFunc(void (*func)(unsigned char, int, int))
+{
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  WINDOW_CONTEXT_LOCK();
+
+  glut_win_ctx->keyboard_cb = func;
+
+  GLUT_UNLOCK();
+}
+
+void glutSpecialFunc(void (*func)(int, int, int))
+{
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  WINDOW_CONTEXT_LOCK();
+
+  glut_win_ctx->special_cb = func;
+
+  GLUT_UNLOCK();
+}
+
+void glutPassiveMotionFunc(void (*func)(int, int))
+{
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  WINDOW_CONTEXT_LOCK();
+
+  glut_win_ctx->passive_motion_cb = func;
+
+  GLUT_UNLOCK();
+}
+
+void glutPassiveMotionHistoryFunc(void (*func)(int, int *, int *))
+{
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  WINDOW_CONTEXT_LOCK();
+
+  glut_win_ctx->passive_motion_history_cb = func;
+  glut_win_ctx->motion_history_count = 0;
+
+  GLUT_UNLOCK();
 }
 
 void glutSwapBuffers()
 {
+  int win = 0;
+  long long start = 0, end = 0;
+
   glut_err = 0;
 
   WINDOW_CHECK();
@@ -441,7 +1551,44 @@ void glutSwapBuffers()
     return;
   }
 
-  SwapBuffersProc(glut_dpy, glut_win);
+  WINDOW_CONTEXT_LOCK();
+
+  win = glut_win_ctx->win;
+
+  GLUT_UNLOCK();
+
+  start = monotonic_time();
+  TRACE("SwapBuffersProc", glut_win, SwapBuffersProc(glut_dpy, win));
+  end = monotonic_time();
+
+  GLUT_LOCK();
+
+  glut_win_ctx = window_slot_get(glut_win);
+  if (glut_win_ctx) {
+    frame_record(glut_win_ctx, start, end);
+    latency_record(glut_win_ctx, end);
+  }
+
+  GLUT_UNLOCK();
+}
+
+void glutSetTargetFrameRate(int fps)
+{
+  glut_err = 0;
+
+  DISPLAY_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  if (fps < 0) {
+    printf("Invalid frame rate\n");
+    glut_err = GLUT_BAD_VALUE;
+    return;
+  }
+
+  glut_frame_period = fps ? 1000000000LL / fps : 0;
+  glut_frame_deadline = 0;
 }
 
 void glutPostRedisplay()
@@ -453,11 +1600,42 @@ void glutPostRedisplay()
     return;
   }
 
-  WINDOW_CONTEXT_GET(glut_win);
+  WINDOW_CONTEXT_LOCK();
+
+  glut_win_ctx->redisplay = 1;
+  glut_redisplay = 1;
+
+  GLUT_UNLOCK();
+
+  window_wakeup();
+}
+
+void glutPostWindowRedisplay(int window)
+{
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  GLUT_LOCK();
 
-  if (glut_win_ctx->display_cb) {
-    glut_win_ctx->display_cb();
+  WINDOW_CONTEXT_GET(window);
+
+  if (!glut_win_ctx) {
+    GLUT_UNLOCK();
+    printf("Invalid window\n");
+    glut_err = GLUT_BAD_VALUE;
+    return;
   }
+
+  glut_win_ctx->redisplay = 1;
+  glut_redisplay = 1;
+
+  GLUT_UNLOCK();
+
+  window_wakeup();
 }
 
 int glutGet(int query)
@@ -465,17 +1643,7 @@ int glutGet(int query)
   glut_err = 0;
 
   if (query == GLUT_ELAPSED_TIME) {
-    struct timeval tv;
-    memset(&tv, 0, sizeof(struct timeval));
-    gettimeofday(&tv, NULL);
-    int t = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-    if (!t0) {
-      t0 = t;
-      return 0;
-    }
-    else {
-      return t - t0;
-    }
+    return elapsed_time() / 1000000;
   }
   else if (query == GLUT_SCREEN_WIDTH || query == GLUT_SCREEN_HEIGHT || query == GLUT_INIT_WINDOW_X || query == GLUT_INIT_WINDOW_Y || query == GLUT_INIT_WINDOW_WIDTH || query == GLUT_INIT_WINDOW_HEIGHT || query == GLUT_INIT_DISPLAY_MODE) {
     DISPLAY_CHECK();
@@ -499,22 +1667,75 @@ int glutGet(int query)
         return mode;
     }
   }
-  else if (query == GLUT_WINDOW_X || query == GLUT_WINDOW_Y || query == GLUT_WINDOW_WIDTH || query == GLUT_WINDOW_HEIGHT || query == GLUT_WINDOW_DOUBLEBUFFER || query == GLUT_WINDOW_DEPTH_SIZE) {
+  else if (query == GLUT_DEVICE_COUNT || query == GLUT_DEVICE_INDEX || query == GLUT_DEVICE_SOFTWARE) {
+    DISPLAY_CHECK();
+    if (glut_err) {
+      return 0;
+    }
+
+    struct attributes *attribs = GetDisplayAttribsProc(glut_dpy);
+
+    switch (query) {
+      case GLUT_DEVICE_COUNT: return attribs->device_count;
+      case GLUT_DEVICE_INDEX: return attribs->device_count ? attribs->device_index : -1;
+      case GLUT_DEVICE_SOFTWARE: return attribs->device_software;
+    }
+  }
+  else if (query == GLUT_WINDOW_X || query == GLUT_WINDOW_Y || query == GLUT_WINDOW_WIDTH || query == GLUT_WINDOW_HEIGHT || query == GLUT_WINDOW_DOUBLEBUFFER || query == GLUT_WINDOW_DEPTH_SIZE) {
+    WINDOW_CHECK();
+    if (glut_err) {
+      return 0;
+    }
+
+    WINDOW_CONTEXT_LOCK(0);
+    int win = glut_win_ctx->win;
+    GLUT_UNLOCK();
+
+    struct attributes *attribs = GetWindowAttribsProc(win);
+
+    switch (query) {
+      case GLUT_WINDOW_X: return attribs->win_posx;
+      case GLUT_WINDOW_Y: return attribs->win_posy;
+      case GLUT_WINDOW_WIDTH: return attribs->win_width;
+      case GLUT_WINDOW_HEIGHT: return attribs->win_height;
+      case GLUT_WINDOW_DOUBLEBUFFER: return attribs->double_buffer;
+      case GLUT_WINDOW_DEPTH_SIZE: return attribs->depth_size;
+    }
+  }
+  else if (query == GLUT_FRAME_TIME_MIN || query == GLUT_FRAME_TIME_AVG || query == GLUT_FRAME_TIME_P50 || query == GLUT_FRAME_TIME_P95 || query == GLUT_FRAME_TIME_P99 || query == GLUT_SWAP_TIME || query == GLUT_DISPLAY_TIME || query == GLUT_INPUT_LATENCY_COUNT || query == GLUT_INPUT_LATENCY_AVG || query == GLUT_INPUT_LATENCY_P50 || query == GLUT_INPUT_LATENCY_P95 || query == GLUT_INPUT_LATENCY_P99) {
     WINDOW_CHECK();
     if (glut_err) {
       return 0;
     }
 
-    struct attributes *attribs = GetWindowAttribsProc(glut_win);
+    WINDOW_CONTEXT_LOCK(0);
+    int value = 0;
 
     switch (query) {
-      case GLUT_WINDOW_X: return attribs->win_posx;
-      case GLUT_WINDOW_Y: return attribs->win_posy;
-      case GLUT_WINDOW_WIDTH: return attribs->win_width;
-      case GLUT_WINDOW_HEIGHT: return attribs->win_height;
-      case GLUT_WINDOW_DOUBLEBUFFER: return attribs->double_buffer;
-      case GLUT_WINDOW_DEPTH_SIZE: return attribs->depth_size;
+      case GLUT_FRAME_TIME_MIN: value = samples_min(&glut_win_ctx->frame_samples); break;
+      case GLUT_FRAME_TIME_AVG: value = samples_avg(&glut_win_ctx->frame_samples); break;
+      case GLUT_FRAME_TIME_P50: value = frame_percentile(glut_win_ctx, 50); break;
+      case GLUT_FRAME_TIME_P95: value = frame_percentile(glut_win_ctx, 95); break;
+      case GLUT_FRAME_TIME_P99: value = frame_percentile(glut_win_ctx, 99); break;
+      case GLUT_SWAP_TIME: value = samples_avg(&glut_win_ctx->swap_samples); break;
+      case GLUT_DISPLAY_TIME: value = samples_avg(&glut_win_ctx->display_samples); break;
+      case GLUT_INPUT_LATENCY_COUNT: value = glut_win_ctx->latency_count; break;
+      case GLUT_INPUT_LATENCY_AVG: value = glut_win_ctx->latency_count ? glut_win_ctx->latency_sum / glut_win_ctx->latency_count : 0; break;
+      case GLUT_INPUT_LATENCY_P50: value = histogram_percentile(glut_win_ctx->latency_histogram, glut_win_ctx->latency_count, 50); break;
+      case GLUT_INPUT_LATENCY_P95: value = histogram_percentile(glut_win_ctx->latency_histogram, glut_win_ctx->latency_count, 95); break;
+      case GLUT_INPUT_LATENCY_P99: value = histogram_percentile(glut_win_ctx->latency_histogram, glut_win_ctx->latency_count, 99); break;
     }
+
+    GLUT_UNLOCK();
+
+    return value;
+  }
+  else if (query == GLUT_DISPATCH_TIME || query == GLUT_FRAMES_DROPPED) {
+    GLUT_LOCK();
+    int value = query == GLUT_DISPATCH_TIME ? samples_avg(&glut_dispatch_samples) : glut_frames_skipped;
+    GLUT_UNLOCK();
+
+    return value;
   }
   else {
     glut_err = GLUT_BAD_VALUE;
@@ -523,6 +1744,63 @@ int glutGet(int query)
   return 0;
 }
 
+long long glutGet64(int query)
+{
+  glut_err = 0;
+
+  if (query == GLUT_ELAPSED_TIME_NS) {
+    return elapsed_time();
+  }
+  else if (query == GLUT_ELAPSED_TIME) {
+    return elapsed_time() / 1000000;
+  }
+
+  return glutGet(query);
+}
+
+const char *glutGetString(int query)
+{
+  glut_err = 0;
+
+  if (query == GLUT_DEVICE_NAME) {
+    DISPLAY_CHECK();
+    if (glut_err) {
+      return NULL;
+    }
+
+    return GetDisplayAttribsProc(glut_dpy)->device_name;
+  }
+  else {
+    glut_err = GLUT_BAD_VALUE;
+  }
+
+  return NULL;
+}
+
+void glutDumpInputLatency()
+{
+  int bucket = 0;
+
+  glut_err = 0;
+
+  WINDOW_CHECK();
+  if (glut_err) {
+    return;
+  }
+
+  WINDOW_CONTEXT_LOCK();
+
+  printf("window %d input latency: %u events, avg %lld us\n", glut_win_ctx->id, glut_win_ctx->latency_count, glut_win_ctx->latency_count ? glut_win_ctx->latency_sum / glut_win_ctx->latency_count : 0);
+
+  for (bucket = 0; bucket < HISTOGRAM_SIZE; bucket++) {
+    if (glut_win_ctx->latency_histogram[bucket]) {
+      printf("  %d-%d us: %u\n", histogram_bound(bucket), histogram_bound(bucket + 1), glut_win_ctx->latency_histogram[bucket]);
+    }
+  }
+
+  GLUT_UNLOCK();
+}
+
 void glutDestroyWindow(int window)
 {
   glut_err = 0;
@@ -532,35 +1810,105 @@ void glutDestroyWindow(int window)
     return;
   }
 
+  GLUT_LOCK();
+
   WINDOW_CONTEXT_GET(window);
 
-  if (glut_win_entry == &glut_win_list) {
+  if (!glut_win_ctx) {
+    GLUT_UNLOCK();
     printf("Invalid window\n");
     glut_err = GLUT_BAD_VALUE;
     return;
   }
 
-  glut_win_entry->next->prev = glut_win_entry->prev;
-  glut_win_entry->prev->next = glut_win_entry->next;
+  glut_win_ctx->entry.next->prev = glut_win_ctx->entry.prev;
+  glut_win_ctx->entry.prev->next = glut_win_ctx->entry.next;
+  glut_win_exist = glut_win_list.next != &glut_win_list;
+
+  window_slot_free(glut_win_ctx->id);
+  window_hash_remove(glut_win_ctx);
+
+  if (glut_win_ctx->motion_pending && !glut_win_ctx->thread_started) {
+    glut_win_ctx->motion_entry.next->prev = glut_win_ctx->motion_entry.prev;
+    glut_win_ctx->motion_entry.prev->next = glut_win_ctx->motion_entry.next;
+  }
 
   if (glut_win_list.next == &glut_win_list) {
     glut_win = 0;
   }
-  else if (glut_win == glut_win_ctx->win) {
-    glut_win = ((glutWindowContext *)glut_win_list.next)->win;
+  else if (glut_win == glut_win_ctx->id) {
+    glut_win = ((glutWindowContext *)glut_win_list.next)->id;
+  }
+
+  glut_win_destroyed++;
+
+  /* the main loop or a render thread may be running a callback of this window, it is destroyed by the main thread */
+  if (glut_win_ctx->thread_started || (glut_loop && !pthread_equal(pthread_self(), glut_main_thread))) {
+    glut_win_ctx->entry.next = &glut_zombie_list;
+    glut_win_ctx->entry.prev = glut_zombie_list.prev;
+    glut_zombie_list.prev->next = &glut_win_ctx->entry;
+    glut_zombie_list.prev = &glut_win_ctx->entry;
+    if (glut_win_ctx->thread_started) {
+      pthread_mutex_lock(&glut_win_ctx->thread_mutex);
+      glut_win_ctx->thread_stop = 1;
+      pthread_cond_signal(&glut_win_ctx->thread_cond);
+      pthread_mutex_unlock(&glut_win_ctx->thread_mutex);
+    }
+    GLUT_UNLOCK();
+    if (pthread_equal(pthread_self(), glut_main_thread)) {
+      window_reap();
+    }
+    else {
+      window_wakeup();
+    }
+    return;
   }
 
-  SetWindowProc(glut_dpy, glut_win_ctx->win, 0);
+  GLUT_UNLOCK();
 
-  DestroyWindowProc(glut_dpy, glut_win_ctx->win);
+  TRACE("SetWindowProc", glut_win_ctx->id, SetWindowProc(glut_dpy, glut_win_ctx->win, 0));
 
-  free(glut_win_ctx);
+  TRACE("DestroyWindowProc", glut_win_ctx->id, DestroyWindowProc(glut_dpy, glut_win_ctx->win));
+
+  window_context_free(glut_win_ctx);
 
   if (glut_win) {
-    SetWindowProc(glut_dpy, glut_win, 1);
+    GLUT_LOCK();
+    glut_win_ctx = window_slot_get(glut_win);
+    window = glut_win_ctx && !glut_win_ctx->thread_started ? glut_win_ctx->win : 0;
+    GLUT_UNLOCK();
+    if (window) {
+      TRACE("SetWindowProc", glut_win, SetWindowProc(glut_dpy, window, 1));
+    }
   }
 }
 
+/* the state of the display is reset, for the next glutInit in the same process */
+static void display_fini()
+{
+  FiniProc(glut_dpy);
+  glut_dpy = 0;
+  trace_stop();
+  t0 = 0;
+  glut_threads = 0;
+  glut_frame_period = 0;
+  glut_frame_deadline = 0;
+  glut_frames_skipped = 0;
+  memset(&glut_dispatch_samples, 0, sizeof(glutSamples));
+  free(glut_timers);
+  glut_timers = NULL;
+  glut_timers_count = glut_timers_size = 0;
+  free(glut_win_slots);
+  glut_win_slots = NULL;
+  glut_win_slots_count = glut_win_slots_size = 0;
+  glut_win_slots_free = -1;
+  free(glut_win_hash);
+  glut_win_hash = NULL;
+  glut_win_hash_count = glut_win_hash_size = 0;
+  dlclose(backend_handle);
+  backend_handle = NULL;
+}
+
 void glutExit()
 {
   glut_err = 0;
@@ -576,28 +1924,308 @@ void glutExit()
     return;
   }
 
-  FiniProc(glut_dpy);
-  glut_dpy = 0;
-  t0 = 0;
-  dlclose(backend_handle);
-  backend_handle = NULL;
+  display_fini();
 }
 
+/* may be called from a signal handler, so only atomics and the eventfd are used here,
+   not glut_mutex, stdio or the thread-local glut_win and glut_err */
 void glutLeaveMainLoop()
 {
-  WINDOW_CHECK();
-  if (glut_err) {
+  int fd = -1;
+
+  if (!glut_win_exist) {
     return;
   }
 
   glut_loop = 0;
+
+  fd = glut_wakeup;
+  if (fd != -1) {
+    eventfd_write(fd, 1);
+  }
+}
+
+static void motion_flush(glutWindowContext *glut_win_ctx)
+{
+  GLUT_LOCK();
+  glut_win_ctx->motion_entry.next->prev = glut_win_ctx->motion_entry.prev;
+  glut_win_ctx->motion_entry.prev->next = glut_win_ctx->motion_entry.next;
+  glut_win_ctx->motion_pending = 0;
+  GLUT_UNLOCK();
+
+  motion_deliver(glut_win_ctx);
+}
+
+static void motion_flush_all()
+{
+  glutWindowContext *glut_win_ctx = NULL;
+
+  while (LOOP_RUNNING()) {
+    GLUT_LOCK();
+    glut_win_ctx = glut_motion_list.next != &glut_motion_list ? (glutWindowContext *)((char *)glut_motion_list.next - offsetof(glutWindowContext, motion_entry)) : NULL;
+    GLUT_UNLOCK();
+    if (!glut_win_ctx) {
+      break;
+    }
+    motion_flush(glut_win_ctx);
+  }
+}
+
+static void dispatch_events(struct event *events, int count)
+{
+  int i = 0;
+  glutWindowContext *glut_win_ctx = NULL;
+  void (*keyboard_cb)(unsigned char, int, int) = NULL;
+  void (*special_cb)(int, int, int) = NULL;
+
+  for (i = 0; i < count && LOOP_RUNNING(); i++) {
+    GLUT_LOCK();
+    glut_win_ctx = window_hash_get(events[i].win);
+    if (glut_win_ctx && glut_win_ctx->thread_started) {
+      if (events[i].type == EVENT_DISPLAY) {
+        glut_win_ctx->redisplay = 1;
+        glut_redisplay = 1;
+      }
+      else {
+        window_thread_post(glut_win_ctx, &events[i]);
+      }
+      glut_win_ctx = NULL;
+    }
+    else if (glut_win_ctx && events[i].type == EVENT_PASSIVEMOTION) {
+      if (glut_win_ctx->passive_motion_cb || glut_win_ctx->passive_motion_history_cb) {
+        if (!glut_win_ctx->motion_pending) {
+          glut_win_ctx->motion_entry.next = &glut_motion_list;
+          glut_win_ctx->motion_entry.prev = glut_motion_list.prev;
+          glut_motion_list.prev->next = &glut_win_ctx->motion_entry;
+          glut_motion_list.prev = &glut_win_ctx->motion_entry;
+        }
+        motion_record(glut_win_ctx, events[i].x, events[i].y, events[i].time);
+      }
+      glut_win_ctx = NULL;
+    }
+    GLUT_UNLOCK();
+
+    if (!glut_win_ctx) {
+      continue;
+    }
+
+    /* deliver the pending motion first to preserve the order of the events of this window */
+    if (glut_win_ctx->motion_pending) {
+      motion_flush(glut_win_ctx);
+      GLUT_LOCK();
+      glut_win_ctx = window_hash_get(events[i].win);
+      GLUT_UNLOCK();
+      if (!glut_win_ctx || !LOOP_RUNNING()) {
+        continue;
+      }
+    }
+
+    switch (events[i].type) {
+      case EVENT_DISPLAY:
+        glut_win_ctx->redisplay = 1;
+        glut_redisplay = 1;
+        break;
+      case EVENT_KEYBOARD:
+        keyboard_cb = glut_win_ctx->keyboard_cb;
+        if (keyboard_cb) {
+          input_pending(glut_win_ctx, events[i].time);
+          WINDOW_SET();
+          TRACE("keyboard_cb", glut_win_ctx->id, keyboard_cb(events[i].key, 0, 0));
+        }
+        break;
+      case EVENT_SPECIAL:
+        special_cb = glut_win_ctx->special_cb;
+        if (special_cb) {
+          input_pending(glut_win_ctx, events[i].time);
+          WINDOW_SET();
+          TRACE("special_cb", glut_win_ctx->id, special_cb(events[i].key, 0, 0));
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void wait_events(int glut_epoll, int glut_timer, long long deadline, int poll_interval)
+{
+  struct epoll_event events[3];
+  struct itimerspec its;
+  unsigned long long expirations = 0;
+  eventfd_t wakeups = 0;
+  long long now = 0;
+  int i = 0, n = 0, timeout = -1;
+
+  if (deadline) {
+    if (glut_timer != -1) {
+      memset(&its, 0, sizeof(struct itimerspec));
+      its.it_value.tv_sec = deadline / 1000000000LL;
+      its.it_value.tv_nsec = deadline % 1000000000LL;
+      timerfd_settime(glut_timer, TFD_TIMER_ABSTIME, &its, NULL);
+    }
+    else {
+      now = monotonic_time();
+      timeout = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+    }
+  }
+
+  if (poll_interval != -1 && (timeout == -1 || timeout > poll_interval)) {
+    timeout = poll_interval;
+  }
+
+  n = epoll_wait(glut_epoll, events, 3, timeout);
+
+  for (i = 0; i < n; i++) {
+    if (events[i].data.fd == glut_timer) {
+      read(glut_timer, &expirations, sizeof(expirations));
+    }
+    else if (events[i].data.fd == glut_wakeup) {
+      eventfd_read(glut_wakeup, &wakeups);
+    }
+  }
+}
+
+static int run_timers(long long now)
+{
+  unsigned int seq = 0;
+  int ran = 0;
+  glutTimer timer;
+
+  GLUT_LOCK();
+
+  seq = glut_timers_seq;
+
+  while (glut_timers_count && glut_timers[0].deadline <= now && (int)(glut_timers[0].seq - seq) < 0 && LOOP_RUNNING()) {
+    timer_heap_pop(&timer);
+    GLUT_UNLOCK();
+    TRACE("timer_cb", 0, timer.func(timer.value));
+    ran++;
+    GLUT_LOCK();
+  }
+
+  GLUT_UNLOCK();
+
+  return ran;
+}
+
+static long long timers_deadline()
+{
+  long long deadline = 0;
+
+  GLUT_LOCK();
+
+  if (glut_timers_count) {
+    deadline = glut_timers[0].deadline;
+  }
+
+  GLUT_UNLOCK();
+
+  return deadline;
+}
+
+static void redisplay_windows()
+{
+  unsigned int destroyed = 0;
+  long long start = 0;
+  glutWindowContext *glut_win_ctx = NULL;
+  glutList *glut_win_entry = NULL;
+  void (*display_cb)() = NULL;
+
+  GLUT_LOCK();
+
+  destroyed = glut_win_destroyed;
+  glut_redisplay = 0;
+
+  for (glut_win_entry = glut_win_list.next; glut_win_entry != &glut_win_list && glut_loop; glut_win_entry = glut_win_entry->next) {
+    glut_win_ctx = (glutWindowContext *)glut_win_entry;
+    if (glut_win_ctx->redisplay) {
+      glut_win_ctx->redisplay = 0;
+      if (glut_win_ctx->thread_started) {
+        window_thread_post(glut_win_ctx, NULL);
+      }
+      else if ((display_cb = glut_win_ctx->display_cb)) {
+        GLUT_UNLOCK();
+        WINDOW_SET();
+        start = monotonic_time();
+        TRACE("display_cb", glut_win_ctx->id, display_cb());
+        GLUT_LOCK();
+        if (destroyed == glut_win_destroyed) {
+          samples_add(&glut_win_ctx->display_samples, (monotonic_time() - start) / 1000);
+        }
+      }
+      if (destroyed != glut_win_destroyed) {
+        destroyed = glut_win_destroyed;
+        glut_win_entry = &glut_win_list;
+      }
+    }
+  }
+
+  GLUT_UNLOCK();
+}
+
+static void window_threads_stop()
+{
+  int win = 0;
+  glutWindowContext *glut_win_ctx = NULL;
+  glutList *glut_win_entry = NULL;
+
+  GLUT_LOCK();
+
+  for (glut_win_entry = glut_win_list.next; glut_win_entry != &glut_win_list; glut_win_entry = glut_win_entry->next) {
+    glut_win_ctx = (glutWindowContext *)glut_win_entry;
+    if (glut_win_ctx->thread_started) {
+      pthread_mutex_lock(&glut_win_ctx->thread_mutex);
+      glut_win_ctx->thread_stop = 1;
+      pthread_cond_signal(&glut_win_ctx->thread_cond);
+      pthread_mutex_unlock(&glut_win_ctx->thread_mutex);
+    }
+  }
+
+  /* render threads may still destroy windows until they are joined, so the list is walked again after each join */
+  while (1) {
+    for (glut_win_entry = glut_win_list.next; glut_win_entry != &glut_win_list; glut_win_entry = glut_win_entry->next) {
+      if (((glutWindowContext *)glut_win_entry)->thread_started) {
+        break;
+      }
+    }
+    if (glut_win_entry == &glut_win_list) {
+      break;
+    }
+    glut_win_ctx = (glutWindowContext *)glut_win_entry;
+    GLUT_UNLOCK();
+    pthread_join(glut_win_ctx->thread, NULL);
+    GLUT_LOCK();
+    glut_win_ctx->thread_started = 0;
+    glut_win_ctx->thread_stop = 0;
+  }
+
+  glut_threads_running = 0;
+
+  GLUT_UNLOCK();
+
+  window_reap();
+
+  if (window_current()) {
+    GLUT_LOCK();
+    glut_win_ctx = window_slot_get(glut_win);
+    win = glut_win_ctx ? glut_win_ctx->win : 0;
+    GLUT_UNLOCK();
+    if (win) {
+      TRACE("SetWindowProc", glut_win, SetWindowProc(glut_dpy, win, 1));
+    }
+  }
 }
 
 void glutMainLoop()
 {
-  int type = EVENT_NONE, key = 0, x = 0, y = 0;
+  struct event events[EVENTS_MAX];
+  int i = 0, count = 0, dispatched = 0, ran = 0, glut_epoll = -1, glut_timer = -1, fd = -1, win = 0, poll_interval = -1;
+  long long now = 0, skipped = 0, deadline = 0, timers = 0, start = 0;
+  struct timespec ts;
+  struct epoll_event event;
   glutWindowContext *glut_win_ctx = NULL;
   glutList *glut_win_entry = NULL;
+  void (*idle_cb)() = NULL;
 
   glut_err = 0;
 
@@ -606,64 +2234,204 @@ void glutMainLoop()
     return;
   }
 
-  for (glut_win_entry = glut_win_list.next; glut_win_entry != &glut_win_list; glut_win_entry = glut_win_entry->next) {
-    glut_win_ctx = (glutWindowContext *)glut_win_entry;
-    if (glut_win_ctx->reshape_cb) {
-      WINDOW_SET();
-      struct attributes *attribs = GetWindowAttribsProc(glut_win);
-      glut_win_ctx->reshape_cb(attribs->win_width, attribs->win_height);
+  glut_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (glut_epoll == -1) {
+    printf("epoll_create1 error\n");
+  }
+
+  fd = GetEventFdProc(glut_dpy);
+  if (fd == -1) {
+    poll_interval = EVENTS_POLL_INTERVAL;
+  }
+  else if (glut_epoll != -1) {
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(glut_epoll, EPOLL_CTL_ADD, fd, &event);
+  }
+
+  if (glut_epoll != -1) {
+    glut_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (glut_timer != -1) {
+      memset(&event, 0, sizeof(struct epoll_event));
+      event.events = EPOLLIN;
+      event.data.fd = glut_timer;
+      epoll_ctl(glut_epoll, EPOLL_CTL_ADD, glut_timer, &event);
     }
   }
 
-  glut_loop = 1;
+  /* other threads wake up the main loop when they post a redisplay, a timer or a destroyed window */
+  glut_main_thread = pthread_self();
 
-  while (glut_loop && glut_win) {
-    int native_win = GetEventProc(glut_dpy, &type, &key, &x, &y);
-    if (native_win) {
-      for (glut_win_entry = glut_win_list.next; glut_win_entry != &glut_win_list; glut_win_entry = glut_win_entry->next) {
-        glut_win_ctx = (glutWindowContext *)glut_win_entry;
-        if (*(int *)(long)glut_win_ctx->win == native_win)
-          break;
+  if (glut_epoll != -1) {
+    if (glut_wakeup == -1) {
+      glut_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    if (glut_wakeup != -1) {
+      memset(&event, 0, sizeof(struct epoll_event));
+      event.events = EPOLLIN;
+      event.data.fd = glut_wakeup;
+      epoll_ctl(glut_epoll, EPOLL_CTL_ADD, glut_wakeup, &event);
+    }
+  }
+
+  if (glut_threads) {
+    /* the contexts are handed over to the render threads, the reshape callbacks run there */
+    GLUT_LOCK();
+    glut_win_ctx = window_slot_get(glut_win);
+    win = glut_win_ctx ? glut_win_ctx->win : 0;
+    GLUT_UNLOCK();
+    if (win) {
+      TRACE("SetWindowProc", glut_win, SetWindowProc(glut_dpy, win, 0));
+    }
+
+    glut_loop = 1;
+
+    GLUT_LOCK();
+    glut_threads_running = 1;
+    for (glut_win_entry = glut_win_list.next; glut_win_entry != &glut_win_list; glut_win_entry = glut_win_entry->next) {
+      window_thread_start((glutWindowContext *)glut_win_entry);
+    }
+    GLUT_UNLOCK();
+  }
+  else {
+    for (glut_win_entry = glut_win_list.next; glut_win_entry != &glut_win_list; glut_win_entry = glut_win_entry->next) {
+      glut_win_ctx = (glutWindowContext *)glut_win_entry;
+      if (glut_win_ctx->reshape_cb) {
+        WINDOW_SET();
+        struct attributes *attribs = GetWindowAttribsProc(glut_win_ctx->win);
+        TRACE("reshape_cb", glut_win_ctx->id, glut_win_ctx->reshape_cb(attribs->win_width, attribs->win_height));
       }
-      switch (type) {
-        case EVENT_DISPLAY:
-          if (glut_win_ctx->display_cb) {
-            WINDOW_SET();
-            glut_win_ctx->display_cb();
-          }
-          break;
-        case EVENT_KEYBOARD:
-          if (glut_win_ctx->keyboard_cb) {
-            WINDOW_SET();
-            glut_win_ctx->keyboard_cb(key, 0, 0);
-          }
-          break;
-        case EVENT_SPECIAL:
-          if (glut_win_ctx->special_cb) {
-            WINDOW_SET();
-            glut_win_ctx->special_cb(key, 0, 0);
-          }
-          break;
-        case EVENT_PASSIVEMOTION:
-          if (glut_win_ctx->passive_motion_cb) {
-            WINDOW_SET();
-            glut_win_ctx->passive_motion_cb(x, y);
-          }
-          break;
-        default:
-          break;
+    }
+
+    glut_loop = 1;
+  }
+
+  while (LOOP_RUNNING()) {
+    start = monotonic_time();
+    dispatched = 0;
+
+    do {
+      TRACE("GetEventsProc", 0, count = GetEventsProc(glut_dpy, events, EVENTS_MAX));
+      now = monotonic_time();
+      for (i = 0; i < count; i++) {
+        if (!events[i].time) {
+          events[i].time = now;
+        }
+      }
+      dispatch_events(events, count);
+      dispatched += count;
+    } while (count == EVENTS_MAX && LOOP_RUNNING());
+
+    motion_flush_all();
+
+    if (dispatched) {
+      GLUT_LOCK();
+      samples_add(&glut_dispatch_samples, (monotonic_time() - start) / 1000);
+      GLUT_UNLOCK();
+    }
+
+    window_reap();
+
+    /* callbacks may make the backend read and queue its events (Xlib, xcb) without its fd becoming readable again,
+       so the backend is polled once more, without blocking, after any callback ran */
+    ran = dispatched;
+
+    if (timers_deadline() && LOOP_RUNNING()) {
+      ran += run_timers(monotonic_time());
+    }
+
+    if (!LOOP_RUNNING()) {
+      break;
+    }
+
+    idle_cb = IdleCb;
+
+    if (!glut_frame_period) {
+      if (!count && idle_cb) {
+        TRACE("IdleCb", 0, idle_cb());
+        ran++;
+      }
+
+      if (glut_redisplay && LOOP_RUNNING()) {
+        redisplay_windows();
+        ran++;
+      }
+
+      if (!ran && !glut_redisplay && glut_epoll != -1 && LOOP_RUNNING()) {
+        wait_events(glut_epoll, glut_timer, timers_deadline(), poll_interval);
+      }
+
+      continue;
+    }
+
+    now = monotonic_time();
+
+    if (!glut_frame_deadline) {
+      glut_frame_deadline = now;
+    }
+
+    if (now >= glut_frame_deadline && (idle_cb || glut_redisplay)) {
+      if (idle_cb) {
+        TRACE("IdleCb", 0, idle_cb());
+      }
+
+      if (glut_redisplay && LOOP_RUNNING()) {
+        redisplay_windows();
+      }
+
+      ran++;
+
+      glut_frame_deadline += glut_frame_period;
+
+      now = monotonic_time();
+      if (now >= glut_frame_deadline) {
+        skipped = (now - glut_frame_deadline) / glut_frame_period + 1;
+        GLUT_LOCK();
+        glut_frames_skipped += skipped;
+        GLUT_UNLOCK();
+        glut_frame_deadline += skipped * glut_frame_period;
       }
     }
-    else if (IdleCb) {
-      IdleCb();
+    else if (now >= glut_frame_deadline) {
+      glut_frame_deadline = now;
     }
+
+    if (ran) {
+      continue;
+    }
+
+    deadline = idle_cb || glut_redisplay ? glut_frame_deadline : 0;
+    timers = timers_deadline();
+    if (timers && (!deadline || timers < deadline)) {
+      deadline = timers;
+    }
+
+    if (glut_epoll != -1 && LOOP_RUNNING()) {
+      wait_events(glut_epoll, glut_timer, deadline, poll_interval);
+    }
+    else if (deadline) {
+      ts.tv_sec = deadline / 1000000000LL;
+      ts.tv_nsec = deadline % 1000000000LL;
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+  }
+
+  if (glut_threads_running) {
+    window_threads_stop();
+  }
+
+  window_reap();
+
+  if (glut_timer != -1) {
+    close(glut_timer);
+  }
+
+  if (glut_epoll != -1) {
+    close(glut_epoll);
   }
 
   if (glut_loop) {
-    FiniProc(glut_dpy);
-    glut_dpy = 0;
-    t0 = 0;
-    dlclose(backend_handle);
-    backend_handle = NULL;
+    display_fini();
   }
 }
@@ -60,6 +60,27 @@ extern "C" {
 #define GLUT_INIT_WINDOW_HEIGHT  0x01F7
 #define GLUT_INIT_DISPLAY_MODE   0x01F8
 #define GLUT_ELAPSED_TIME        0x02BC
+#define GLUT_ELAPSED_TIME_NS     0x02BD
+#define GLUT_FRAME_TIME_MIN      0x0300
+#define GLUT_FRAME_TIME_AVG      0x0301
+#define GLUT_FRAME_TIME_P50      0x0302
+#define GLUT_FRAME_TIME_P95      0x0303
+#define GLUT_FRAME_TIME_P99      0x0304
+#define GLUT_SWAP_TIME           0x0305
+#define GLUT_DISPLAY_TIME        0x0306
+#define GLUT_DISPATCH_TIME       0x0307
+#define GLUT_FRAMES_DROPPED      0x0308
+#define GLUT_INPUT_LATENCY_COUNT 0x0309
+#define GLUT_INPUT_LATENCY_AVG   0x030A
+#define GLUT_INPUT_LATENCY_P50   0x030B
+#define GLUT_INPUT_LATENCY_P95   0x030C
+#define GLUT_INPUT_LATENCY_P99   0x030D
+#define GLUT_DEVICE_COUNT        0x0310
+#define GLUT_DEVICE_INDEX        0x0311
+#define GLUT_DEVICE_SOFTWARE     0x0312
+
+/* Get string query */
+#define GLUT_DEVICE_NAME         0x0320
 
 /* Special key */
 #define GLUT_KEY_F1              0x0001
@@ -86,6 +107,7 @@ extern "C" {
 
 /* Functions */
 int glutGetError();
+void glutInitDevice(const char *device);
 void glutInit(int *argc, char **argv);
 void glutInitWindowPosition(int posx, int posy);
 void glutInitWindowSize(int width, int height);
@@ -98,12 +120,19 @@ void *glutGetWindowData();
 void glutReshapeFunc(void (*func)(int width, int height));
 void glutDisplayFunc(void (*func)());
 void glutIdleFunc(void (*func)());
+void glutTimerFunc(unsigned int msecs, void (*func)(int value), int value);
 void glutKeyboardFunc(void (*func)(unsigned char key, int x, int y));
 void glutSpecialFunc(void (*func)(int key, int x, int y));
 void glutPassiveMotionFunc(void (*func)(int x, int y));
+void glutPassiveMotionHistoryFunc(void (*func)(int count, int *x, int *y));
 void glutSwapBuffers();
+void glutSetTargetFrameRate(int fps);
 void glutPostRedisplay();
+void glutPostWindowRedisplay(int window);
 int glutGet(int query);
+long long glutGet64(int query);
+const char *glutGetString(int query);
+void glutDumpInputLatency();
 void glutDestroyWindow(int window);
 void glutExit();
 void glutLeaveMainLoop();
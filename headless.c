@@ -0,0 +1,146 @@
+/*
+  TinyGLUT                 Small implementation of GLUT (OpenGL Utility Toolkit)
+  Copyright (c) 2015-2024, Nicolas Caramelli
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice, this
+     list of conditions and the following disclaimer.
+
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "event.h"
+
+/* windows are pbuffers of a surfaceless EGL display, only their expose state is kept here */
+#define WIDTH 640
+#define HEIGHT 480
+
+struct headless_window {
+  int id;
+  int expose;
+  struct headless_window *next;
+};
+
+static struct headless_window *windows = NULL;
+static int window_id = 0;
+
+int init(int *width, int *height, int *err)
+{
+  if (getenv("WIDTH") && getenv("HEIGHT")) {
+    *width = atoi(getenv("WIDTH"));
+    *height = atoi(getenv("HEIGHT"));
+  }
+  else {
+    *width = WIDTH;
+    *height = HEIGHT;
+  }
+
+  if (*width <= 0 || *height <= 0) {
+    printf("invalid WIDTH or HEIGHT\n");
+    goto fail;
+  }
+
+  *err = 0;
+
+  return 0;
+
+fail:
+  *err = -1;
+  return 0;
+}
+
+int create_window(int display, int posx, int posy, int width, int height, int opt, int *err)
+{
+  struct headless_window *window = NULL;
+
+  window = calloc(1, sizeof(struct headless_window));
+  if (!window) {
+    printf("headless_window calloc failed\n");
+    goto fail;
+  }
+
+  window->id = ++window_id;
+  window->next = windows;
+  windows = window;
+
+  *err = 0;
+
+  return window->id;
+
+fail:
+  *err = -1;
+  return 0;
+}
+
+void destroy_window(int display, int win)
+{
+  struct headless_window **window, *next;
+
+  for (window = &windows; *window; window = &(*window)->next) {
+    if ((*window)->id == win) {
+      next = (*window)->next;
+      free(*window);
+      *window = next;
+      break;
+    }
+  }
+}
+
+void fini(int display)
+{
+  struct headless_window *next;
+
+  while (windows) {
+    next = windows->next;
+    free(windows);
+    windows = next;
+  }
+}
+
+int get_events(int display, struct event *events, int count)
+{
+  struct headless_window *window;
+  int n = 0;
+
+  for (window = windows; window && n < count; window = window->next) {
+    if (!window->expose) {
+      memset(&events[n], 0, sizeof(struct event));
+      events[n].win = window->id;
+      events[n].type = EVENT_DISPLAY;
+      window->expose = 1;
+      n++;
+    }
+  }
+
+  return n;
+}
+
+int get_event_fd(int display)
+{
+  return -1;
+}
+
+int get_native_platform(int display)
+{
+  return EGL_PLATFORM_SURFACELESS_MESA;
+}
@@ -24,6 +24,7 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -437,75 +438,103 @@ void fini(int dpy)
   wl_display_disconnect(display);
 }
 
-int get_event(int dpy, int *type, int *key, int *x, int *y)
+static void dispatch_events(struct wl_display *display)
+{
+  struct pollfd fd;
+
+  while (wl_display_prepare_read(display) == -1) {
+    wl_display_dispatch_pending(display);
+  }
+
+  wl_display_flush(display);
+
+  fd.fd = wl_display_get_fd(display);
+  fd.events = POLLIN;
+  if (poll(&fd, 1, 0) > 0) {
+    wl_display_read_events(display);
+  }
+  else {
+    wl_display_cancel_read(display);
+  }
+
+  wl_display_dispatch_pending(display);
+}
+
+int get_events(int dpy, struct event *events, int count)
 {
   struct wl_display *display = (struct wl_display *)(long)dpy;
   struct wl_user_data *user_data = NULL;
   struct wl_event *event = NULL;
-  struct wl_list *event_link = NULL;
-  int win = 0;
+  int key = 0, n = 0;
 
   user_data = wl_display_get_user_data(display);
 
-  *type = EVENT_NONE;
-  *key = *x = *y = 0;
-
   wl_display_dispatch_pending(display);
 
-  event_link = &user_data->event_list;
-  while (event_link->next != &user_data->event_list) {
-    event_link = event_link->next;
+  if (wl_list_empty(&user_data->event_list)) {
+    dispatch_events(display);
   }
 
-  if (event_link != &user_data->event_list) {
-    event = (struct wl_event *)((char *)event_link  - (char *)&((struct wl_event *)NULL)->link);
+  while (n < count && !wl_list_empty(&user_data->event_list)) {
+    event = wl_container_of(user_data->event_list.prev, event, link);
+    memset(&events[n], 0, sizeof(struct event));
+    events[n].win = (long)event->window;
     if (event->type == WL_EVENT_EXPOSE) {
-      *type = EVENT_DISPLAY;
+      events[n].type = EVENT_DISPLAY;
     }
     else if (event->type == WL_EVENT_KEYBOARD) {
       switch (event->keysym) {
-        case XKB_KEY_F1:        *key = F1;        break;
-        case XKB_KEY_F2:        *key = F2;        break;
-        case XKB_KEY_F3:        *key = F3;        break;
-        case XKB_KEY_F4:        *key = F4;        break;
-        case XKB_KEY_F5:        *key = F5;        break;
-        case XKB_KEY_F6:        *key = F6;        break;
-        case XKB_KEY_F7:        *key = F7;        break;
-        case XKB_KEY_F8:        *key = F8;        break;
-        case XKB_KEY_F9:        *key = F9;        break;
-        case XKB_KEY_F10:       *key = F10;       break;
-        case XKB_KEY_F11:       *key = F11;       break;
-        case XKB_KEY_F12:       *key = F12;       break;
-        case XKB_KEY_Left:      *key = LEFT;      break;
-        case XKB_KEY_Up:        *key = UP;        break;
-        case XKB_KEY_Right:     *key = RIGHT;     break;
-        case XKB_KEY_Down:      *key = DOWN;      break;
-        case XKB_KEY_Page_Up:   *key = PAGE_UP;   break;
-        case XKB_KEY_Page_Down: *key = PAGE_DOWN; break;
-        default:                *key = 0;         break;
+        case XKB_KEY_F1:        key = F1;         break;
+        case XKB_KEY_F2:        key = F2;         break;
+        case XKB_KEY_F3:        key = F3;         break;
+        case XKB_KEY_F4:        key = F4;         break;
+        case XKB_KEY_F5:        key = F5;         break;
+        case XKB_KEY_F6:        key = F6;         break;
+        case XKB_KEY_F7:        key = F7;         break;
+        case XKB_KEY_F8:        key = F8;         break;
+        case XKB_KEY_F9:        key = F9;         break;
+        case XKB_KEY_F10:       key = F10;        break;
+        case XKB_KEY_F11:       key = F11;        break;
+        case XKB_KEY_F12:       key = F12;        break;
+        case XKB_KEY_Left:      key = LEFT;       break;
+        case XKB_KEY_Up:        key = UP;         break;
+        case XKB_KEY_Right:     key = RIGHT;      break;
+        case XKB_KEY_Down:      key = DOWN;       break;
+        case XKB_KEY_Page_Up:   key = PAGE_UP;    break;
+        case XKB_KEY_Page_Down: key = PAGE_DOWN;  break;
+        default:                key = 0;          break;
       }
-      if (!*key) {
+      if (!key) {
         char string[7];
         xkb_keysym_to_utf8(event->keysym, (char *)&string, sizeof(string));
-        *key = string[0];
-        *type = EVENT_KEYBOARD;
+        events[n].key = string[0];
+        events[n].type = EVENT_KEYBOARD;
       }
       else {
-        *type = EVENT_SPECIAL;
+        events[n].key = key;
+        events[n].type = EVENT_SPECIAL;
       }
     }
     else if (event->type == WL_EVENT_POINTER) {
-      *x = event->x;
-      *y = event->y;
-      *type = EVENT_PASSIVEMOTION;
+      events[n].x = event->x;
+      events[n].y = event->y;
+      events[n].type = EVENT_PASSIVEMOTION;
     }
-  }
 
-  if (*type) {
-    win = (long)event->window;
     wl_list_remove(&event->link);
     free(event);
+
+    if (events[n].type) {
+      n++;
+    }
   }
 
-  return win;
+  return n;
+}
+
+int get_event_fd(int dpy)
+{
+  struct wl_display *display = (struct wl_display *)(long)dpy;
+
+  return wl_display_get_fd(display);
 }
@@ -25,6 +25,7 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <X11/Xutil.h>
 #include "event.h"
@@ -34,6 +35,10 @@ int init(int *width, int *height, int *err)
 {
   Display *display = NULL;
 
+  if (getenv("GLUT_THREADS") && atoi(getenv("GLUT_THREADS"))) {
+    XInitThreads();
+  }
+
   display = XOpenDisplay(NULL);
   if (!display) {
     printf("XOpenDisplay failed\n");
@@ -93,76 +98,75 @@ void fini(int dpy)
   XCloseDisplay(display);
 }
 
-int get_event(int dpy, int *type, int *key, int *x, int *y)
+int get_events(int dpy, struct event *events, int count)
 {
   Display *display = (Display *)(long)dpy;
   XEvent event;
   char keycode = 0;
   KeySym keysym = 0;
-  int win = 0;
+  int pending = 0, key = 0, n = 0;
 
-  *type = EVENT_NONE;
-  *key = *x = *y = 0;
+  pending = XPending(display);
 
-  if (XPending((Display *)display)) {
+  while (n < count && pending--) {
     memset(&event, 0, sizeof(XEvent));
-    XNextEvent((Display *)display, &event);
+    XNextEvent(display, &event);
+    memset(&events[n], 0, sizeof(struct event));
     if (event.type == Expose) {
-      *type = EVENT_DISPLAY;
+      events[n].win = event.xexpose.window;
+      events[n].type = EVENT_DISPLAY;
     }
     else if (event.type == KeyPress) {
       XLookupString(&event.xkey, &keycode, 1, &keysym, NULL);
       switch (keysym) {
-        case XK_F1:             *key = F1;        break;
-        case XK_F2:             *key = F2;        break;
-        case XK_F3:             *key = F3;        break;
-        case XK_F4:             *key = F4;        break;
-        case XK_F5:             *key = F5;        break;
-        case XK_F6:             *key = F6;        break;
-        case XK_F7:             *key = F7;        break;
-        case XK_F8:             *key = F8;        break;
-        case XK_F9:             *key = F9;        break;
-        case XK_F10:            *key = F10;       break;
-        case XK_F11:            *key = F11;       break;
-        case XK_F12:            *key = F12;       break;
-        case XK_Left:           *key = LEFT;      break;
-        case XK_Up:             *key = UP;        break;
-        case XK_Right:          *key = RIGHT;     break;
-        case XK_Down:           *key = DOWN;      break;
-        case XK_Page_Up:        *key = PAGE_UP;   break;
-        case XK_Page_Down:      *key = PAGE_DOWN; break;
-        default:                *key = 0;         break;
+        case XK_F1:             key = F1;         break;
+        case XK_F2:             key = F2;         break;
+        case XK_F3:             key = F3;         break;
+        case XK_F4:             key = F4;         break;
+        case XK_F5:             key = F5;         break;
+        case XK_F6:             key = F6;         break;
+        case XK_F7:             key = F7;         break;
+        case XK_F8:             key = F8;         break;
+        case XK_F9:             key = F9;         break;
+        case XK_F10:            key = F10;        break;
+        case XK_F11:            key = F11;        break;
+        case XK_F12:            key = F12;        break;
+        case XK_Left:           key = LEFT;       break;
+        case XK_Up:             key = UP;         break;
+        case XK_Right:          key = RIGHT;      break;
+        case XK_Down:           key = DOWN;       break;
+        case XK_Page_Up:        key = PAGE_UP;    break;
+        case XK_Page_Down:      key = PAGE_DOWN;  break;
+        default:                key = 0;          break;
       }
-      if (!*key) {
-        *key = keycode;
-        *type = EVENT_KEYBOARD;
+      events[n].win = event.xkey.window;
+      if (!key) {
+        events[n].key = keycode;
+        events[n].type = EVENT_KEYBOARD;
       }
       else {
-        *type = EVENT_SPECIAL;
+        events[n].key = key;
+        events[n].type = EVENT_SPECIAL;
       }
     }
     else if (event.type == MotionNotify) {
-      *x = event.xmotion.x;
-      *y = event.xmotion.x;
-      *type = EVENT_PASSIVEMOTION;
+      events[n].win = event.xmotion.window;
+      events[n].x = event.xmotion.x;
+      events[n].y = event.xmotion.y;
+      events[n].type = EVENT_PASSIVEMOTION;
     }
-  }
 
-  if (*type) {
-    switch (event.type) {
-      case Expose:
-        win = event.xexpose.window;
-        break;
-      case KeyPress:
-        win = event.xkey.window;
-        break;
-      case MotionNotify:
-        win = event.xmotion.window;
-        break;
-      default:
-        break;
+    if (events[n].type) {
+      n++;
     }
   }
 
-  return win;
+  return n;
+}
+
+int get_event_fd(int dpy)
+{
+  Display *display = (Display *)(long)dpy;
+
+  return ConnectionNumber(display);
 }
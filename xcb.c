@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <xcb/xcb.h>
 #include <xcb/xcb_keysyms.h>
 #include "event.h"
@@ -102,74 +103,67 @@ void fini(int dpy)
   xcb_disconnect(connection);
 }
 
-int get_event(int dpy, int *type, int *key, int *x, int *y)
+int get_events(int dpy, struct event *events, int count)
 {
   xcb_connection_t *connection = (xcb_connection_t *)(long)dpy;
   xcb_generic_event_t *event = NULL;
   xcb_key_symbols_t *key_symbols = NULL;
   xcb_keysym_t keysym;
-  int win = 0;
+  int key = 0, n = 0;
 
-  *type = EVENT_NONE;
-  *key = *x = *y = 0;
-
-  event = xcb_poll_for_event(connection);
-  if (event) {
+  while (n < count && (event = xcb_poll_for_event(connection))) {
+    memset(&events[n], 0, sizeof(struct event));
     if ((event->response_type & 0x7f) == XCB_EXPOSE) {
-      *type = EVENT_DISPLAY;
+      events[n].win = ((xcb_expose_event_t *)event)->window;
+      events[n].type = EVENT_DISPLAY;
     }
     else if ((event->response_type & 0x7f) == XCB_KEY_PRESS) {
-      key_symbols = xcb_key_symbols_alloc(connection);
+      if (!key_symbols) {
+        key_symbols = xcb_key_symbols_alloc(connection);
+      }
       keysym = xcb_key_symbols_get_keysym(key_symbols, ((xcb_key_press_event_t *)event)->detail, 0);
       switch (keysym) {
-        case 0xffbe:            *key = F1;        break;
-        case 0xffbf:            *key = F2;        break;
-        case 0xffc0:            *key = F3;        break;
-        case 0xffc1:            *key = F4;        break;
-        case 0xffc2:            *key = F5;        break;
-        case 0xffc3:            *key = F6;        break;
-        case 0xffc4:            *key = F7;        break;
-        case 0xffc5:            *key = F8;        break;
-        case 0xffc6:            *key = F9;        break;
-        case 0xffc7:            *key = F10;       break;
-        case 0xffc8:            *key = F11;       break;
-        case 0xffc9:            *key = F12;       break;
-        case 0xff51:            *key = LEFT;      break;
-        case 0xff52:            *key = UP;        break;
-        case 0xff53:            *key = RIGHT;     break;
-        case 0xff54:            *key = DOWN;      break;
-        case 0xff55:            *key = PAGE_UP;   break;
-        case 0xff56:            *key = PAGE_DOWN; break;
-        default:                *key = 0;         break;
+        case 0xffbe:            key = F1;         break;
+        case 0xffbf:            key = F2;         break;
+        case 0xffc0:            key = F3;         break;
+        case 0xffc1:            key = F4;         break;
+        case 0xffc2:            key = F5;         break;
+        case 0xffc3:            key = F6;         break;
+        case 0xffc4:            key = F7;         break;
+        case 0xffc5:            key = F8;         break;
+        case 0xffc6:            key = F9;         break;
+        case 0xffc7:            key = F10;        break;
+        case 0xffc8:            key = F11;        break;
+        case 0xffc9:            key = F12;        break;
+        case 0xff51:            key = LEFT;       break;
+        case 0xff52:            key = UP;         break;
+        case 0xff53:            key = RIGHT;      break;
+        case 0xff54:            key = DOWN;       break;
+        case 0xff55:            key = PAGE_UP;    break;
+        case 0xff56:            key = PAGE_DOWN;  break;
+        default:                key = 0;          break;
       }
-      if (!*key) {
-        *key = keysym;
-        *type = EVENT_KEYBOARD;
+      events[n].win = ((xcb_key_press_event_t *)event)->event;
+      if (!key) {
+        events[n].key = keysym;
+        events[n].type = EVENT_KEYBOARD;
       }
       else {
-        *type = EVENT_SPECIAL;
+        events[n].key = key;
+        events[n].type = EVENT_SPECIAL;
       }
     }
     else if ((event->response_type & 0x7f) == XCB_MOTION_NOTIFY) {
-      *x = ((xcb_motion_notify_event_t *)event)->event_x;
-      *y = ((xcb_motion_notify_event_t *)event)->event_y;
-      *type = EVENT_PASSIVEMOTION;
+      events[n].win = ((xcb_motion_notify_event_t *)event)->event;
+      events[n].x = ((xcb_motion_notify_event_t *)event)->event_x;
+      events[n].y = ((xcb_motion_notify_event_t *)event)->event_y;
+      events[n].type = EVENT_PASSIVEMOTION;
     }
-  }
 
-  if (*type) {
-    switch (event->response_type & 0x7f) {
-      case XCB_EXPOSE:
-        win = ((xcb_expose_event_t *)event)->window;
-        break;
-      case XCB_KEY_PRESS:
-        win = ((xcb_motion_notify_event_t *)event)->event;
-        break;
-      case XCB_MOTION_NOTIFY:
-        win = ((xcb_motion_notify_event_t *)event)->event;
-        break;
-      default:
-        break;
+    free(event);
+
+    if (events[n].type) {
+      n++;
     }
   }
 
@@ -177,9 +171,12 @@ int get_event(int dpy, int *type, int *key, int *x, int *y)
     xcb_key_symbols_free(key_symbols);
   }
 
-  if (event) {
-    free(event);
-  }
+  return n;
+}
+
+int get_event_fd(int dpy)
+{
+  xcb_connection_t *connection = (xcb_connection_t *)(long)dpy;
 
-  return win;
+  return xcb_get_file_descriptor(connection);
 }